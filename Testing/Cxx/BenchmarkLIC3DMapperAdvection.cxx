@@ -0,0 +1,125 @@
+// Time the advection of the particles of the mapper over a swirl, rendered
+// offscreen, for a number of threads and with or without NUMAPlacement:
+//
+//   BenchmarkLIC3DMapperAdvection <threads> <placement 0|1> [particles]
+//
+// The time of the steps is read from the vtkLIC3DMapper::UpdateParticles
+// events of the timer log. Scaling is measured by running it for each number
+// of threads, for instance 1, 32, 64 and 128 on a two sockets node, with the
+// threads bound to their cores (OMP_PROC_BIND=close OMP_SCHEDULE=static with
+// the OpenMP backend of vtkSMPTools).
+
+#include "vtkActor.h"
+#include "vtkFloatArray.h"
+#include "vtkImageData.h"
+#include "vtkLIC3DMapper.h"
+#include "vtkMultiThreader.h"
+#include "vtkNew.h"
+#include "vtkPointData.h"
+#include "vtkRenderWindow.h"
+#include "vtkRenderer.h"
+#include "vtkSMPTools.h"
+#include "vtkTimerLog.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+const int NumberOfCells = 256;
+const int NumberOfWarmUpFrames = 10;
+const int NumberOfFrames = 100;
+const char* AdvectionEvent = "vtkLIC3DMapper::UpdateParticles";
+
+// Wall time of the advection events logged since the last reset
+double GetAdvectionTime()
+{
+	double time = 0.;
+	double start = 0.;
+	for (int i = 0; i < vtkTimerLog::GetNumberOfEvents(); i++)
+	{
+		if (std::strcmp(vtkTimerLog::GetEventString(i), AdvectionEvent) != 0)
+		{
+			continue;
+		}
+		if (vtkTimerLog::GetEventType(i) == vtkTimerLog::START)
+		{
+			start = vtkTimerLog::GetEventWallTime(i);
+		}
+		else if (vtkTimerLog::GetEventType(i) == vtkTimerLog::END)
+		{
+			time += vtkTimerLog::GetEventWallTime(i) - start;
+		}
+	}
+	return time;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		std::cerr << "Usage: " << argv[0] << " <threads> <placement 0|1> [particles]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	const int nbThreads = std::max(1, std::atoi(argv[1]));
+	const bool placement = std::atoi(argv[2]) != 0;
+	const vtkIdType nbParticles = argc > 3 ? std::atoll(argv[3]) : 10000000;
+	vtkSMPTools::Initialize(nbThreads);
+	vtkMultiThreader::SetGlobalDefaultNumberOfThreads(nbThreads);
+
+	// Swirl over the unit box, large enough not to fit in the caches
+	vtkNew<vtkImageData> image;
+	image->SetDimensions(NumberOfCells + 1, NumberOfCells + 1, NumberOfCells + 1);
+	image->SetSpacing(1. / NumberOfCells, 1. / NumberOfCells, 1. / NumberOfCells);
+	vtkNew<vtkFloatArray> vectors;
+	vectors->SetName("V");
+	vectors->SetNumberOfComponents(3);
+	vectors->SetNumberOfTuples(image->GetNumberOfPoints());
+	for (vtkIdType i = 0; i < image->GetNumberOfPoints(); i++)
+	{
+		double p[3];
+		image->GetPoint(i, p);
+		vectors->SetTuple3(i, 0.5 - p[1], p[0] - 0.5, 0.2 * (0.5 - p[2]));
+	}
+	image->GetPointData()->SetVectors(vectors.Get());
+
+	vtkNew<vtkLIC3DMapper> mapper;
+	mapper->SetController(NULL);
+	mapper->SetInputData(image.Get());
+	mapper->SetNumberOfParticles(nbParticles);
+	mapper->SetNUMAPlacement(placement);
+	mapper->SetScalarVisibility(0);
+	vtkNew<vtkActor> actor;
+	actor->SetMapper(mapper.Get());
+	vtkNew<vtkRenderer> renderer;
+	renderer->AddActor(actor.Get());
+	vtkNew<vtkRenderWindow> window;
+	window->SetOffScreenRendering(1);
+	window->SetSize(512, 512);
+	window->AddRenderer(renderer.Get());
+	renderer->ResetCamera();
+
+	// The first frames seed the particles and sort them
+	for (int i = 0; i < NumberOfWarmUpFrames; i++)
+	{
+		window->Render();
+	}
+
+	vtkTimerLog::LoggingOn();
+	vtkTimerLog::SetMaxEntries(100000);
+	vtkTimerLog::ResetLog();
+	for (int i = 0; i < NumberOfFrames; i++)
+	{
+		window->Render();
+	}
+	const double time = GetAdvectionTime();
+
+	std::cout << nbThreads << " threads, NUMAPlacement " << (placement ? "on" : "off") << ": "
+			  << nbParticles << " particles advected in " << time / NumberOfFrames
+			  << " s per step, " << nbParticles * NumberOfFrames / time << " particles/s"
+			  << std::endl;
+	return EXIT_SUCCESS;
+}
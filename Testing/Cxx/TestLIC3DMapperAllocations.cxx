@@ -0,0 +1,245 @@
+// Render a steady animation of the mapper offscreen for 1000 frames and count
+// the heap allocations made while it renders. VTK allocates a little at each
+// frame whatever the number of particles (uniform names, texture units of the
+// window...), so the allocations are compared to the ones of a baseline
+// mapper with the same passes and chunks but a single particle per chunk: a
+// mapper allocating per particle or per chunk temporary, such as a color
+// array returned by MapScalars(), allocates more or larger blocks.
+//
+// The allocations are counted by interposing malloc() and its siblings, which
+// the data arrays use directly and operator new goes through, so this test
+// requires the GNU C library.
+
+#include "vtkActor.h"
+#include "vtkDoubleArray.h"
+#include "vtkImageData.h"
+#include "vtkLIC3DMapper.h"
+#include "vtkNew.h"
+#include "vtkObjectFactory.h"
+#include "vtkPointData.h"
+#include "vtkRenderWindow.h"
+#include "vtkRenderer.h"
+#include "vtkTimerLog.h"
+#include "vtkUnsignedCharArray.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+
+#if !defined(__GLIBC__)
+#error "TestLIC3DMapperAllocations interposes the allocator of the GNU C library"
+#endif
+
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* ptr, std::size_t size);
+void* __libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void* ptr);
+}
+
+namespace
+{
+// Allocations made while Counting is set, from any thread
+std::atomic<bool> Counting(false);
+std::atomic<long long> Allocations(0);
+std::atomic<long long> AllocatedBytes(0);
+std::atomic<std::size_t> LargestAllocation(0);
+
+void CountAllocation(std::size_t size)
+{
+	if (!Counting.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+	Allocations++;
+	AllocatedBytes += static_cast<long long>(size);
+	std::size_t largest = LargestAllocation.load();
+	while (size > largest && !LargestAllocation.compare_exchange_weak(largest, size))
+	{
+	}
+}
+}
+
+extern "C" {
+void* malloc(std::size_t size) noexcept
+{
+	CountAllocation(size);
+	return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size) noexcept
+{
+	CountAllocation(count * size);
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, std::size_t size) noexcept
+{
+	CountAllocation(size);
+	return __libc_realloc(ptr, size);
+}
+
+void* memalign(std::size_t alignment, std::size_t size) noexcept
+{
+	CountAllocation(size);
+	return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size) noexcept
+{
+	CountAllocation(size);
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, std::size_t alignment, std::size_t size) noexcept
+{
+	if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+	{
+		return EINVAL;
+	}
+	CountAllocation(size);
+	*ptr = __libc_memalign(alignment, size);
+	return *ptr ? 0 : ENOMEM;
+}
+
+void free(void* ptr) noexcept
+{
+	__libc_free(ptr);
+}
+}
+
+namespace
+{
+const vtkIdType NumberOfParticles = 100000;
+const vtkIdType NumberOfChunks = 3;
+const int NumberOfWarmUpFrames = 200;
+const int NumberOfFrames = 1000;
+
+struct FrameAllocations
+{
+	long long Count;
+	long long Bytes;
+	std::size_t Largest;
+};
+
+// Counts the allocations of its renders only, not the ones of the window
+class vtkCountingLIC3DMapper : public vtkLIC3DMapper
+{
+public:
+	static vtkCountingLIC3DMapper* New();
+	vtkTypeMacro(vtkCountingLIC3DMapper, vtkLIC3DMapper);
+
+	void Render(vtkRenderer* ren, vtkActor* actor) VTK_OVERRIDE
+	{
+		Counting = this->Count;
+		this->Superclass::Render(ren, actor);
+		Counting = false;
+	}
+
+	bool Count = false;
+};
+vtkStandardNewMacro(vtkCountingLIC3DMapper);
+
+FrameAllocations CountFrameAllocations(
+	vtkDataArray* scalars, int colorMode, vtkIdType nbParticles)
+{
+	// Swirl over the unit box
+	vtkNew<vtkImageData> image;
+	image->SetDimensions(33, 33, 33);
+	image->SetSpacing(1. / 32., 1. / 32., 1. / 32.);
+	vtkNew<vtkDoubleArray> vectors;
+	vectors->SetName("V");
+	vectors->SetNumberOfComponents(3);
+	vectors->SetNumberOfTuples(image->GetNumberOfPoints());
+	scalars->SetNumberOfTuples(image->GetNumberOfPoints());
+	for (vtkIdType i = 0; i < image->GetNumberOfPoints(); i++)
+	{
+		double p[3];
+		image->GetPoint(i, p);
+		vectors->SetTuple3(i, 0.5 - p[1], p[0] - 0.5, 0.1);
+		for (int c = 0; c < scalars->GetNumberOfComponents(); c++)
+		{
+			scalars->SetComponent(i, c, 255. * p[c % 3]);
+		}
+	}
+	image->GetPointData()->SetVectors(vectors.Get());
+	image->GetPointData()->SetScalars(scalars);
+
+	// The same number of chunks whatever the number of particles, some of the
+	// particles advected at each step
+	vtkNew<vtkCountingLIC3DMapper> mapper;
+	mapper->SetController(NULL);
+	mapper->SetInputData(image.Get());
+	mapper->SetNumberOfParticles(nbParticles);
+	mapper->SetDrawChunkSize((nbParticles + NumberOfChunks - 1) / NumberOfChunks);
+	mapper->SetUpdateFraction(0.5);
+	mapper->SetColorMode(colorMode);
+	mapper->SetScalarRange(0., 255.);
+	vtkNew<vtkActor> actor;
+	actor->SetMapper(mapper.Get());
+	vtkNew<vtkRenderer> renderer;
+	renderer->AddActor(actor.Get());
+	vtkNew<vtkRenderWindow> window;
+	window->SetOffScreenRendering(1);
+	window->SetSize(300, 300);
+	window->AddRenderer(renderer.Get());
+	renderer->ResetCamera();
+
+	// Buffers, shaders and sorts are set up by the first frames
+	for (int i = 0; i < NumberOfWarmUpFrames; i++)
+	{
+		window->Render();
+	}
+
+	Allocations = 0;
+	AllocatedBytes = 0;
+	LargestAllocation = 0;
+	mapper->Count = true;
+	for (int i = 0; i < NumberOfFrames; i++)
+	{
+		window->Render();
+	}
+	mapper->Count = false;
+
+	FrameAllocations allocations;
+	allocations.Count = Allocations;
+	allocations.Bytes = AllocatedBytes;
+	allocations.Largest = LargestAllocation;
+	return allocations;
+}
+
+bool CheckFrameAllocations(vtkDataArray* scalars, int colorMode, const char* name)
+{
+	const FrameAllocations baseline = CountFrameAllocations(scalars, colorMode, NumberOfChunks);
+	const FrameAllocations allocations =
+		CountFrameAllocations(scalars, colorMode, NumberOfParticles);
+	std::cout << name << ", " << NumberOfFrames << " frames: " << allocations.Count
+			  << " allocations of " << allocations.Bytes << " bytes, the largest of "
+			  << allocations.Largest << " bytes, for " << baseline.Count << " allocations of "
+			  << baseline.Bytes << " bytes, the largest of " << baseline.Largest
+			  << " bytes, with a particle per chunk" << std::endl;
+	if (allocations.Count > baseline.Count || allocations.Bytes > baseline.Bytes ||
+		allocations.Largest > baseline.Largest)
+	{
+		std::cerr << name << ": the frames allocate more than the baseline" << std::endl;
+		return false;
+	}
+	return true;
+}
+}
+
+int main(int, char*[])
+{
+	vtkTimerLog::LoggingOff();
+
+	vtkNew<vtkDoubleArray> mapped;
+	vtkNew<vtkUnsignedCharArray> direct;
+	direct->SetNumberOfComponents(3);
+	const bool mappedOk =
+		CheckFrameAllocations(mapped.Get(), VTK_COLOR_MODE_MAP_SCALARS, "Mapped colors");
+	const bool directOk =
+		CheckFrameAllocations(direct.Get(), VTK_COLOR_MODE_DIRECT_SCALARS, "Direct colors");
+	return mappedOk && directOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,197 @@
+// Advect the particles of an image partitioned in slabs along X over the
+// processes, with a layer of ghost cells, around the Z axis so that they move
+// from slab to slab. Every process calls UpdateDistributedTrails() before each
+// render, then checks that it received particles from the others and that the
+// composited trails cover the slabs of all the processes.
+//
+// Run with mpiexec, for instance on 4 processes.
+
+#include "vtkActor.h"
+#include "vtkCamera.h"
+#include "vtkCellData.h"
+#include "vtkDataSetAttributes.h"
+#include "vtkDoubleArray.h"
+#include "vtkImageData.h"
+#include "vtkLIC3DMapper.h"
+#include "vtkMPIController.h"
+#include "vtkNew.h"
+#include "vtkPointData.h"
+#include "vtkRenderWindow.h"
+#include "vtkRenderer.h"
+#include "vtkUnsignedCharArray.h"
+#include "vtkWindowToImageFilter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+// Cells of the whole image along each axis, over the unit box
+const int NumberOfCells = 32;
+const int NumberOfFrames = 60;
+const int WindowSize = 300;
+const double ParallelScale = 0.55;
+// Trail pixels in the part of the image showing each slab
+const int MinimumTrailPixels = 20;
+
+void MakePiece(vtkImageData* image, int procId, int nbProcs)
+{
+	// Owned cells along X, and one layer of ghost cells on each side
+	const int first = NumberOfCells * procId / nbProcs;
+	const int last = NumberOfCells * (procId + 1) / nbProcs;
+	const int begin = std::max(0, first - 1);
+	const int end = std::min(NumberOfCells, last + 1);
+	image->SetExtent(begin, end, 0, NumberOfCells, 0, NumberOfCells);
+	image->SetSpacing(1. / NumberOfCells, 1. / NumberOfCells, 1. / NumberOfCells);
+
+	// Swirl around the Z axis of the box
+	vtkNew<vtkDoubleArray> vectors;
+	vectors->SetName("V");
+	vectors->SetNumberOfComponents(3);
+	vectors->SetNumberOfTuples(image->GetNumberOfPoints());
+	for (vtkIdType i = 0; i < image->GetNumberOfPoints(); i++)
+	{
+		double p[3];
+		image->GetPoint(i, p);
+		vectors->SetTuple3(i, 0.5 - p[1], p[0] - 0.5, 0.);
+	}
+	image->GetPointData()->SetVectors(vectors.Get());
+
+	vtkNew<vtkUnsignedCharArray> ghosts;
+	ghosts->SetName(vtkDataSetAttributes::GhostArrayName());
+	ghosts->SetNumberOfTuples(image->GetNumberOfCells());
+	const int nbCellsX = end - begin;
+	for (vtkIdType c = 0; c < image->GetNumberOfCells(); c++)
+	{
+		const int i = begin + static_cast<int>(c % nbCellsX);
+		ghosts->SetValue(c, i < first || i >= last ? vtkDataSetAttributes::DUPLICATECELL : 0);
+	}
+	image->GetCellData()->AddArray(ghosts.Get());
+}
+
+// Count the lit pixels of the columns of the image showing each slab,
+// leaving out their ghost cells
+bool CheckTrails(vtkRenderWindow* window, int nbProcs)
+{
+	vtkNew<vtkWindowToImageFilter> capture;
+	capture->SetInput(window);
+	capture->SetInputBufferTypeToRGB();
+	capture->ReadFrontBufferOff();
+	capture->Update();
+	vtkImageData* image = capture->GetOutput();
+	int dims[3];
+	image->GetDimensions(dims);
+	vtkUnsignedCharArray* pixels =
+		vtkUnsignedCharArray::SafeDownCast(image->GetPointData()->GetScalars());
+
+	bool ok = pixels != NULL;
+	for (int p = 0; ok && p < nbProcs; p++)
+	{
+		// The camera looks down the Z axis with a parallel projection, the
+		// height of the image showing twice ParallelScale
+		const double pixelsPerUnit = dims[1] / (2. * ParallelScale);
+		const double xMin = static_cast<double>(p) / nbProcs + 1. / NumberOfCells;
+		const double xMax = static_cast<double>(p + 1) / nbProcs - 1. / NumberOfCells;
+		const int columnMin = static_cast<int>(dims[0] / 2 + (xMin - 0.5) * pixelsPerUnit);
+		const int columnMax = static_cast<int>(dims[0] / 2 + (xMax - 0.5) * pixelsPerUnit);
+		int lit = 0;
+		for (int y = 0; y < dims[1]; y++)
+		{
+			for (int x = std::max(0, columnMin); x <= std::min(dims[0] - 1, columnMax); x++)
+			{
+				const unsigned char* rgb = pixels->GetPointer(3 * (x + y * dims[0]));
+				lit += std::max(rgb[0], std::max(rgb[1], rgb[2])) > 32 ? 1 : 0;
+			}
+		}
+		if (lit < MinimumTrailPixels)
+		{
+			std::cerr << "No composited trails in the slab of process " << p << " (" << lit
+					  << " pixels)" << std::endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+bool TestDistributedTrails(vtkMultiProcessController* controller)
+{
+	const int procId = controller->GetLocalProcessId();
+	const int nbProcs = controller->GetNumberOfProcesses();
+
+	vtkNew<vtkImageData> image;
+	MakePiece(image.Get(), procId, nbProcs);
+
+	vtkNew<vtkLIC3DMapper> mapper;
+	mapper->SetController(controller);
+	mapper->SetInputData(image.Get());
+	mapper->SetNumberOfParticles(20000);
+	mapper->SetStepLength(0.02);
+	mapper->SetMaxTimeToLive(200);
+	mapper->SetScalarVisibility(0);
+	vtkNew<vtkActor> actor;
+	actor->SetMapper(mapper.Get());
+	vtkNew<vtkRenderer> renderer;
+	renderer->AddActor(actor.Get());
+	vtkNew<vtkRenderWindow> window;
+	window->SetOffScreenRendering(1);
+	window->SetSize(WindowSize, WindowSize);
+	window->AddRenderer(renderer.Get());
+
+	// The bounds of the pieces differ, the camera must not be reset from them
+	vtkCamera* camera = renderer->GetActiveCamera();
+	camera->ParallelProjectionOn();
+	camera->SetParallelScale(ParallelScale);
+	camera->SetFocalPoint(0.5, 0.5, 0.5);
+	camera->SetPosition(0.5, 0.5, 3.);
+	camera->SetViewUp(0., 1., 0.);
+	camera->SetClippingRange(1., 5.);
+
+	// The first render creates the context the trails are drawn in
+	window->Render();
+	for (int i = 0; i < NumberOfFrames; i++)
+	{
+		mapper->UpdateDistributedTrails(renderer.Get(), actor.Get());
+		window->Render();
+	}
+
+	// Every slab has particles coming from its neighbors
+	vtkIdType received = mapper->GetNumberOfReceivedParticles();
+	vtkIdType minimumReceived = 0;
+	controller->AllReduce(&received, &minimumReceived, 1, vtkCommunicator::MIN_OP);
+	int ok = 1;
+	if (minimumReceived <= 0)
+	{
+		std::cerr << "Process " << procId << " received " << received << " particles, "
+				  << "some process received none" << std::endl;
+		ok = 0;
+	}
+
+	// All the processes present the same composited trails
+	ok = CheckTrails(window.Get(), nbProcs) && ok;
+	int allOk = 0;
+	controller->AllReduce(&ok, &allOk, 1, vtkCommunicator::MIN_OP);
+	return allOk != 0;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	vtkNew<vtkMPIController> controller;
+	controller->Initialize(&argc, &argv);
+	vtkMultiProcessController::SetGlobalController(controller.Get());
+
+	bool ok = controller->GetNumberOfProcesses() > 1;
+	if (!ok)
+	{
+		std::cerr << "TestLIC3DMapperDistributed needs several processes" << std::endl;
+	}
+	else
+	{
+		ok = TestDistributedTrails(controller.Get());
+	}
+
+	vtkMultiProcessController::SetGlobalController(NULL);
+	controller->Finalize();
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,129 @@
+// Encode the particles of a mapper and decode them in another one, checking
+// that the segments survive the quantization, including one starting at the
+// minimum of the bounds, and that a delta following a lost stream is rejected
+// until the next key frame.
+
+#include "vtkDoubleArray.h"
+#include "vtkImageData.h"
+#include "vtkLIC3DMapper.h"
+#include "vtkNew.h"
+#include "vtkPointData.h"
+#include "vtkUnsignedCharArray.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+const vtkIdType NumberOfParticles = 100;
+
+bool CheckSegments(vtkLIC3DMapper* encoder, vtkLIC3DMapper* decoder, const char* frame)
+{
+	// 16 bits over a unit box
+	const double tolerance = 1e-4;
+	for (vtkIdType i = 0; i < NumberOfParticles; i++)
+	{
+		double expected[6];
+		double decoded[6];
+		encoder->GetParticleSegment(i, expected, expected + 3);
+		decoder->GetParticleSegment(i, decoded, decoded + 3);
+		for (int c = 0; c < 6; c++)
+		{
+			if (std::abs(expected[c] - decoded[c]) > tolerance)
+			{
+				std::cerr << frame << ": particle " << i << " decoded at (" << decoded[0] << ", "
+						  << decoded[1] << ", " << decoded[2] << ") -> (" << decoded[3] << ", "
+						  << decoded[4] << ", " << decoded[5] << ") instead of (" << expected[0]
+						  << ", " << expected[1] << ", " << expected[2] << ") -> (" << expected[3]
+						  << ", " << expected[4] << ", " << expected[5] << ")" << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+}
+
+int TestLIC3DMapperStream(int, char*[])
+{
+	// Swirl over the unit box, with scalars
+	vtkNew<vtkImageData> image;
+	image->SetDimensions(11, 11, 11);
+	image->SetSpacing(0.1, 0.1, 0.1);
+	vtkNew<vtkDoubleArray> vectors;
+	vectors->SetName("V");
+	vectors->SetNumberOfComponents(3);
+	vectors->SetNumberOfTuples(image->GetNumberOfPoints());
+	vtkNew<vtkDoubleArray> scalars;
+	scalars->SetName("S");
+	scalars->SetNumberOfTuples(image->GetNumberOfPoints());
+	for (vtkIdType i = 0; i < image->GetNumberOfPoints(); i++)
+	{
+		double p[3];
+		image->GetPoint(i, p);
+		vectors->SetTuple3(i, 0.5 - p[1], p[0] - 0.5, 0.1);
+		scalars->SetValue(i, p[2]);
+	}
+	image->GetPointData()->SetVectors(vectors.Get());
+	image->GetPointData()->SetScalars(scalars.Get());
+
+	vtkNew<vtkLIC3DMapper> encoder;
+	encoder->SetController(NULL);
+	encoder->SetInputData(image.Get());
+	encoder->SetNumberOfParticles(NumberOfParticles);
+	encoder->SetStepLength(0.05);
+	encoder->SetKeyFrameInterval(4);
+
+	vtkNew<vtkLIC3DMapper> decoder;
+	decoder->SetController(NULL);
+	decoder->RemoteAdvectionOn();
+
+	vtkNew<vtkUnsignedCharArray> stream;
+
+	// Key frame, then a delta
+	for (int frame = 0; frame < 2; frame++)
+	{
+		encoder->AdvectParticles();
+		encoder->EncodeParticles(stream.Get());
+		if (!decoder->DecodeParticles(stream.Get()))
+		{
+			std::cerr << "Frame " << frame << " not decoded" << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (!CheckSegments(encoder.Get(), decoder.Get(), frame == 0 ? "Key frame" : "Delta"))
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	// A lost delta: the next one cannot be decoded
+	encoder->AdvectParticles();
+	encoder->EncodeParticles(stream.Get());
+	encoder->AdvectParticles();
+	encoder->EncodeParticles(stream.Get());
+	if (decoder->DecodeParticles(stream.Get()))
+	{
+		std::cerr << "Delta decoded after a lost stream" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// The next key frame is decoded again. Its first segment starts at the
+	// minimum of the bounds, which quantizes like the zeroed history of a key
+	// frame, while the decoder still holds other positions.
+	encoder->AdvectParticles();
+	const double start[3] = { 0., 0., 0. };
+	const double end[3] = { 0.01, 0.02, 0.03 };
+	encoder->SetParticleSegment(0, start, end);
+	encoder->EncodeParticles(stream.Get());
+	if (!decoder->DecodeParticles(stream.Get()))
+	{
+		std::cerr << "Key frame not decoded after a lost stream" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!CheckSegments(encoder.Get(), decoder.Get(), "Key frame after a loss"))
+	{
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,35 @@
+# Animating the view must not execute the 3D LIC representation again: view
+# passes alone do not mark it modified.
+import sys
+from paraview.simple import *
+
+LoadPlugin(sys.argv[1], ns=globals())
+
+wavelet = Wavelet()
+wavelet.WholeExtent = [-10, 10, -10, 10, -10, 10]
+calculator = Calculator(Input=wavelet)
+calculator.ResultArrayName = "V"
+calculator.Function = "coordsY*iHat-coordsX*jHat+kHat"
+
+view = CreateRenderView()
+view.ViewSize = [300, 300]
+display = Show(calculator, view)
+display.SetRepresentationType("3D LIC")
+display.InputVectors = ["POINTS", "V"]
+ColorBy(display, ("POINTS", "RTData"))
+Render(view)
+
+lic = display.SMProxy.GetSubProxy("LIC3DRepresentation")
+def requestDataCount():
+    lic.UpdatePropertyInformation()
+    return lic.GetProperty("RequestDataCount").GetElement(0)
+
+count = requestDataCount()
+camera = view.GetActiveCamera()
+for i in range(1000):
+    camera.Azimuth(0.36)
+    Render(view)
+
+executions = requestDataCount() - count
+if executions != 0:
+    raise RuntimeError("The representation was executed %d times by 1000 renders" % executions)
@@ -0,0 +1,31 @@
+# With caching on and a derived data cache of 0 MiB, every product is released
+# as soon as it is added: the representation must not use it afterwards.
+import sys
+from paraview.simple import *
+
+LoadPlugin(sys.argv[1], ns=globals())
+
+wavelet = Wavelet()
+wavelet.WholeExtent = [-10, 10, -10, 10, -10, 10]
+calculator = Calculator(Input=wavelet)
+calculator.ResultArrayName = "V"
+calculator.Function = "coordsY*iHat-coordsX*jHat+kHat"
+
+view = CreateRenderView()
+view.ViewSize = [300, 300]
+display = Show(calculator, view)
+display.SetRepresentationType("3D LIC")
+display.InputVectors = ["POINTS", "V"]
+display.UseLIC = 1
+display.LICProgressive = 0
+display.ProductCacheSize = 0
+ColorBy(display, ("POINTS", "RTData"))
+
+# Caching as done by the animation scene when looping over time steps
+view.UseCache = 1
+for loop in range(2):
+    for key in range(4):
+        view.CacheKey = float(key)
+        Render(view)
+view.UseCache = 0
+Render(view)
@@ -35,21 +35,44 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "pqRenderView.h"
 #include "pqRepresentation.h"
 #include "pqServerManagerModel.h"
+#include "pqSettings.h"
 #include "pqView.h"
 
+#include "vtkCommand.h"
+#include "vtkEventQtSlotConnect.h"
+#include "vtkSMProperty.h"
 #include "vtkSMPropertyHelper.h"
 #include "vtkSMRepresentationProxy.h"
 #include "vtkSMViewProxy.h"
 
+#include <QWidget>
 #include <QtDebug>
 
+#include <algorithm>
+
+namespace
+{
+// Representation properties defining whether a LIC representation is shown
+const char* TrackedProperties[] = { "Representation", "Visibility" };
+const int NumberOfTrackedProperties = 2;
+}
+
 //-----------------------------------------------------------------------------
 pqLIC3DAnimationManager::pqLIC3DAnimationManager(QObject* p /*=0*/)
   : QObject(p)
+  , TargetFrameRate(30.)
 {
   pqServerManagerModel* smmodel = pqApplicationCore::instance()->getServerManagerModel();
   QObject::connect(smmodel, SIGNAL(preViewAdded(pqView*)), this, SLOT(onViewAdded(pqView*)));
   QObject::connect(smmodel, SIGNAL(preViewRemoved(pqView*)), this, SLOT(onViewRemoved(pqView*)));
+
+  this->Timer.setSingleShot(true);
+  QObject::connect(&this->Timer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+  this->LastTick.start();
+
+  pqSettings* settings = pqApplicationCore::instance()->settings();
+  this->setTargetFrameRate(
+    settings->value("LIC3DRepresentation/TargetFrameRate", this->TargetFrameRate).toDouble());
 }
 
 //-----------------------------------------------------------------------------
@@ -57,25 +80,176 @@ pqLIC3DAnimationManager::~pqLIC3DAnimationManager()
 {
 }
 
+//-----------------------------------------------------------------------------
+void pqLIC3DAnimationManager::setTargetFrameRate(double fps)
+{
+  this->TargetFrameRate = std::max(fps, 1.);
+}
+
+//-----------------------------------------------------------------------------
+bool pqLIC3DAnimationManager::isViewVisible(pqView* view)
+{
+  QWidget* widget = view->widget();
+  return widget && widget->isVisible() && !widget->window()->isMinimized();
+}
+
+//-----------------------------------------------------------------------------
+bool pqLIC3DAnimationManager::isAnimated(pqRepresentation* pqRepr)
+{
+  vtkSMRepresentationProxy* repr = vtkSMRepresentationProxy::SafeDownCast(pqRepr->getProxy());
+  if (!repr || !repr->GetProperty("Representation"))
+  {
+    return false;
+  }
+  const char* rs = vtkSMPropertyHelper(repr, "Representation").GetAsString();
+  const int visible = vtkSMPropertyHelper(repr, "Visibility").GetAsInt();
+  return rs && !strcmp(rs, "3D LIC") && visible;
+}
+
+//-----------------------------------------------------------------------------
+bool pqLIC3DAnimationManager::needsMoreFrames(pqRepresentation* pqRepr)
+{
+  vtkSMProxy* lic = pqRepr->getProxy()->GetSubProxy("LIC3DRepresentation");
+  vtkSMProperty* prop = lic ? lic->GetProperty("NeedsMoreFrames") : NULL;
+  if (!prop)
+  {
+    return false;
+  }
+  lic->UpdatePropertyInformation(prop);
+  return vtkSMPropertyHelper(prop).GetAsInt() != 0;
+}
+
+//-----------------------------------------------------------------------------
+void pqLIC3DAnimationManager::updateRepresentation(pqRepresentation* repr)
+{
+  QHash<pqRepresentation*, bool>::iterator it = this->Animated.find(repr);
+  if (it == this->Animated.end())
+  {
+    return;
+  }
+  const bool animated = this->isAnimated(repr);
+  if (animated != it.value())
+  {
+    it.value() = animated;
+    pqView* view = this->RepresentationViews.value(repr);
+    if (animated)
+    {
+      this->AnimatedRepresentations[view].insert(repr);
+    }
+    else
+    {
+      this->AnimatedRepresentations[view].remove(repr);
+    }
+    if (animated && view)
+    {
+      // Restart the animation
+      view->render();
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+void pqLIC3DAnimationManager::onRepresentationAdded(pqRepresentation* repr)
+{
+  if (this->Animated.contains(repr))
+  {
+    return;
+  }
+  pqView* view = qobject_cast<pqView*>(this->sender());
+  this->Animated.insert(repr, false);
+  this->RepresentationViews.insert(repr, view ? view : repr->getView());
+
+  vtkSMProxy* proxy = repr->getProxy();
+  for (int i = 0; i < NumberOfTrackedProperties; ++i)
+  {
+    if (vtkSMProperty* prop = proxy->GetProperty(TrackedProperties[i]))
+    {
+      this->VTKConnect->Connect(prop, vtkCommand::ModifiedEvent, this,
+        SLOT(onRepresentationModified(vtkObject*, unsigned long, void*)), repr);
+    }
+  }
+  this->updateRepresentation(repr);
+}
+
+//-----------------------------------------------------------------------------
+void pqLIC3DAnimationManager::onRepresentationRemoved(pqRepresentation* repr)
+{
+  QHash<pqRepresentation*, bool>::iterator it = this->Animated.find(repr);
+  if (it == this->Animated.end())
+  {
+    return;
+  }
+  if (it.value())
+  {
+    this->AnimatedRepresentations[this->RepresentationViews.value(repr)].remove(repr);
+  }
+  this->Animated.erase(it);
+  this->RepresentationViews.remove(repr);
+
+  vtkSMProxy* proxy = repr->getProxy();
+  for (int i = 0; i < NumberOfTrackedProperties; ++i)
+  {
+    if (vtkSMProperty* prop = proxy->GetProperty(TrackedProperties[i]))
+    {
+      this->VTKConnect->Disconnect(prop);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+void pqLIC3DAnimationManager::onRepresentationModified(vtkObject*, unsigned long, void* clientData)
+{
+  this->updateRepresentation(static_cast<pqRepresentation*>(clientData));
+}
+
 //-----------------------------------------------------------------------------
 void pqLIC3DAnimationManager::onRenderEnded()
 {
   pqView* view = dynamic_cast<pqView*>(sender());
-  QList<pqRepresentation*> reprs = view->getRepresentations();
-  for (int i = 0; i < reprs.count(); ++i)
+  QHash<pqView*, QSet<pqRepresentation*> >::const_iterator animated =
+    this->AnimatedRepresentations.constFind(view);
+  if (!view || animated == this->AnimatedRepresentations.constEnd() || animated->isEmpty() ||
+    !this->isViewVisible(view))
+  {
+    return;
+  }
+
+  // Only the representations of the view still changing the image ask for
+  // another render
+  bool needed = false;
+  for (QSet<pqRepresentation*>::const_iterator it = animated->constBegin();
+       it != animated->constEnd() && !needed; ++it)
+  {
+    needed = this->needsMoreFrames(*it);
+  }
+  if (!needed)
+  {
+    return;
+  }
+
+  // This view as a visible animated LIC3D representation.
+  // Let's schedule a new render! Views ending their render before the next
+  // tick share it.
+  this->PendingViews.insert(view);
+  if (!this->Timer.isActive())
+  {
+    const qint64 period = static_cast<qint64>(1000. / this->TargetFrameRate);
+    this->Timer.start(static_cast<int>(std::max<qint64>(0, period - this->LastTick.elapsed())));
+  }
+}
+
+//-----------------------------------------------------------------------------
+void pqLIC3DAnimationManager::onTimeout()
+{
+  this->LastTick.restart();
+  std::set<pqView*> views;
+  views.swap(this->PendingViews);
+  for (std::set<pqView*>::iterator it = views.begin(); it != views.end(); ++it)
   {
-    vtkSMRepresentationProxy* repr = vtkSMRepresentationProxy::SafeDownCast(reprs[i]->getProxy());
-    if (repr && repr->GetProperty("Representation"))
+    // Views may have been removed or hidden meanwhile
+    if (this->Views.count(*it) && this->isViewVisible(*it))
     {
-      const char* rs = vtkSMPropertyHelper(repr, "Representation").GetAsString();
-      const int visible = vtkSMPropertyHelper(repr, "Visibility").GetAsInt();
-      if (rs && !strcmp(rs, "3D LIC") && visible)
-      {
-        // This view as a visible LIC3D representation.
-        // Let's ask for a new render!
-        view->render();
-        break;
-      }
+      (*it)->render();
     }
   }
 }
@@ -86,7 +260,18 @@ void pqLIC3DAnimationManager::onViewAdded(pqView* view)
   if (dynamic_cast<pqRenderView*>(view))
   {
     this->Views.insert(view);
+    this->AnimatedRepresentations.insert(view, QSet<pqRepresentation*>());
     QObject::connect(view, SIGNAL(endRender()), this, SLOT(onRenderEnded()));
+    QObject::connect(view, SIGNAL(representationAdded(pqRepresentation*)), this,
+      SLOT(onRepresentationAdded(pqRepresentation*)));
+    QObject::connect(view, SIGNAL(representationRemoved(pqRepresentation*)), this,
+      SLOT(onRepresentationRemoved(pqRepresentation*)));
+
+    QList<pqRepresentation*> reprs = view->getRepresentations();
+    for (int i = 0; i < reprs.count(); ++i)
+    {
+      this->onRepresentationAdded(reprs[i]);
+    }
   }
 }
 
@@ -96,6 +281,18 @@ void pqLIC3DAnimationManager::onViewRemoved(pqView* view)
   if (dynamic_cast<pqRenderView*>(view))
   {
     QObject::disconnect(view, SIGNAL(endRender()), this, SLOT(onRenderEnded()));
+    QObject::disconnect(view, SIGNAL(representationAdded(pqRepresentation*)), this,
+      SLOT(onRepresentationAdded(pqRepresentation*)));
+    QObject::disconnect(view, SIGNAL(representationRemoved(pqRepresentation*)), this,
+      SLOT(onRepresentationRemoved(pqRepresentation*)));
+
+    QList<pqRepresentation*> reprs = view->getRepresentations();
+    for (int i = 0; i < reprs.count(); ++i)
+    {
+      this->onRepresentationRemoved(reprs[i]);
+    }
+    this->AnimatedRepresentations.remove(view);
     this->Views.erase(view);
+    this->PendingViews.erase(view);
   }
 }
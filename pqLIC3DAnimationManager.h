@@ -37,6 +37,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * a rendering pass ends. If a representation of type StreamLines if found
  * then render() is triggered to ensure the next update of the simulation.
  *
+ * Renders are throttled to a target frame rate (see setTargetFrameRate(),
+ * initialized from the "LIC3DRepresentation/TargetFrameRate" setting) and
+ * requests coming from several views are coalesced into a single timer tick.
+ * Views that are hidden or minimized, or whose LIC representations report
+ * through their "NeedsMoreFrames" information property that the image will
+ * not change anymore, are not re-rendered.
+ *
+ * To keep the per-frame check cheap, the set of visible LIC representations
+ * of each view is maintained incrementally, when representations are added or
+ * removed and when their properties change. After a render, only the ones of
+ * the rendered view are queried.
+ *
  * @par Thanks:
  * This class was written by Joachim Pouderoux and Bastien Jacquet, Kitware 2017
  * This work was supported by Total SA.
@@ -45,11 +57,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef pqLIC3DAnimationManager_h
 #define pqLIC3DAnimationManager_h
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QObject>
+#include <QSet>
+#include <QTimer>
+
+#include "vtkNew.h"
 
 #include <set>
 
+class pqRepresentation;
 class pqView;
+class vtkEventQtSlotConnect;
+class vtkObject;
 
 class pqLIC3DAnimationManager : public QObject
 {
@@ -63,15 +84,59 @@ public:
   void onShutdown() {}
   void onStartup() {}
 
+  /**
+   * Maximum number of animation frames rendered per second, for all views.
+   * Default is 30.
+   */
+  double targetFrameRate() const { return this->TargetFrameRate; }
+
 public slots:
   void onViewAdded(pqView*);
   void onViewRemoved(pqView*);
+  void setTargetFrameRate(double fps);
 
 protected slots:
   void onRenderEnded();
+  void onTimeout();
+  void onRepresentationAdded(pqRepresentation*);
+  void onRepresentationRemoved(pqRepresentation*);
+  void onRepresentationModified(vtkObject*, unsigned long, void*);
 
 protected:
+  /**
+   * Returns true if the view is shown on screen.
+   */
+  static bool isViewVisible(pqView*);
+
+  /**
+   * Returns true if the representation is a visible 3D LIC one.
+   */
+  static bool isAnimated(pqRepresentation*);
+
+  /**
+   * Returns true if the 3D LIC representation reports that the next renders
+   * still change the image.
+   */
+  static bool needsMoreFrames(pqRepresentation*);
+
+  /**
+   * Update the animated representations of the representation's view
+   * according to its current state.
+   */
+  void updateRepresentation(pqRepresentation*);
+
   std::set<pqView*> Views;
+  std::set<pqView*> PendingViews;
+
+  // Whether the tracked representations are visible 3D LIC ones, and the
+  // ones of each view.
+  QHash<pqRepresentation*, bool> Animated;
+  QHash<pqRepresentation*, pqView*> RepresentationViews;
+  QHash<pqView*, QSet<pqRepresentation*> > AnimatedRepresentations;
+  vtkNew<vtkEventQtSlotConnect> VTKConnect;
+  QTimer Timer;
+  QElapsedTimer LastTick;
+  double TargetFrameRate;
 
 private:
   Q_DISABLE_COPY(pqLIC3DAnimationManager)
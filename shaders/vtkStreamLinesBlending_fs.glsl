@@ -5,6 +5,8 @@ varying vec2 tcoordVC;
 
 uniform sampler2D prev;
 uniform sampler2D current;
+uniform sampler2D prevDepth;
+uniform sampler2D currentDepth;
 uniform float alpha;
 
 void main(void)
@@ -12,4 +14,6 @@ void main(void)
   vec4 pc = texture2D(prev, tcoordVC);
   vec4 cc = texture2D(current, tcoordVC);
   gl_FragData[0] = pc * alpha + cc;
+  // Keep the depth of the latest segment drawn on this pixel
+  gl_FragData[1] = cc.a > 0.0 ? texture2D(currentDepth, tcoordVC) : texture2D(prevDepth, tcoordVC);
 }
@@ -0,0 +1,10 @@
+//VTK::System::Dec
+//VTK::Output::Dec
+
+varying vec4 colorVSOutput;
+
+void main(void)
+{
+  gl_FragData[0] = colorVSOutput;
+  gl_FragData[1] = vec4(gl_FragCoord.z);
+}
@@ -0,0 +1,27 @@
+//VTK::System::Dec
+
+uniform sampler2D prevColor;
+uniform sampler2D prevDepth;
+uniform mat4 reprojectionMatrix;
+
+varying vec4 colorVSOutput;
+
+void main(void)
+{
+  // One point is issued per texel of the previous accumulation buffer
+  ivec2 size = textureSize(prevColor, 0);
+  ivec2 texel = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);
+  colorVSOutput = texelFetch(prevColor, texel, 0);
+  float depth = texelFetch(prevDepth, texel, 0).r;
+
+  if (colorVSOutput.a <= 0.0)
+  {
+    // Empty texel: send it outside of the clipping volume
+    gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+    return;
+  }
+
+  // Unproject with the previous camera and project with the new one
+  vec2 ndc = (vec2(texel) + vec2(0.5)) / vec2(size) * 2.0 - 1.0;
+  gl_Position = reprojectionMatrix * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+}
@@ -7,11 +7,15 @@ uniform vec3 color;
 uniform int scalarVisibility;
 
 varying vec3 vertexColorVSOutput;
+varying float fadeVSOutput;
 
 void main(void)
 {
+  if (fadeVSOutput <= 0.)
+    discard;
   if (scalarVisibility != 0)
-    gl_FragData[0] = vec4(vertexColorVSOutput, 1.);
+    gl_FragData[0] = vec4(vertexColorVSOutput, 1.) * fadeVSOutput;
   else
-    gl_FragData[0] = vec4(color, 1.);
+    gl_FragData[0] = vec4(color, 1.) * fadeVSOutput;
+  gl_FragData[1] = vec4(gl_FragCoord.z);
 }
@@ -4,8 +4,10 @@
 // clang-format on
 
 in vec3 vertexColorVSOutput[];
+in float fadeVSOutput[];
 
 out vec3 vertexColorGSOutput;
+out float fadeGSOutput;
 
 uniform vec2 lineWidthNVC;
 
@@ -26,6 +28,7 @@ void main()
     int i = j / 2;
 
     vertexColorGSOutput = vertexColorVSOutput[i];
+    fadeGSOutput = fadeVSOutput[i];
 
     gl_Position = vec4(gl_in[i].gl_Position.xy +
         (lineWidthNVC * normal) * ((j + 1) % 2 - 0.5) * gl_in[i].gl_Position.w,
@@ -1,15 +1,37 @@
 //VTK::System::Dec
 //VTK::Output::Dec
 
-attribute vec4 vertexMC;
-attribute vec3 scalarColor;
+// Each particle is an instance whose two vertices are the ends of its
+// segment, read from the two slots of its ring of positions. ring is the slot
+// of the current position, plus 2 when the other one holds the previous
+// position. Quantized positions are read normalized to [0, 1] and mapped to
+// the bounds of the data.
+attribute vec4 vertexMC0;
+attribute vec4 vertexMC1;
+attribute vec4 scalarColor0;
+attribute vec4 scalarColor1;
+attribute float ring;
+attribute float segmentFade;
 
 uniform mat4 MCDCMatrix;
+uniform int fadeSegments;
+uniform int quantizedPositions;
+uniform vec3 quantizationOrigin;
+uniform vec3 quantizationScale;
 
 varying vec3 vertexColorVSOutput;
+varying float fadeVSOutput;
 
 void main(void)
 {
-  vertexColorVSOutput = scalarColor.rgb;
+  int head = int(mod(ring, 2.));
+  int slot = (gl_VertexID == 1 || ring < 2.) ? head : 1 - head;
+  vertexColorVSOutput = slot == 0 ? scalarColor0.rgb : scalarColor1.rgb;
+  fadeVSOutput = fadeSegments != 0 ? segmentFade : 1.;
+  vec4 vertexMC = slot == 0 ? vertexMC0 : vertexMC1;
+  if (quantizedPositions != 0)
+  {
+    vertexMC = vec4(quantizationOrigin + vertexMC.xyz * quantizationScale, 1.);
+  }
   gl_Position = MCDCMatrix * vertexMC;
 }
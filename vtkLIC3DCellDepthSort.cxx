@@ -0,0 +1,253 @@
+#include "vtkLIC3DCellDepthSort.h"
+
+#include "vtkCamera.h"
+#include "vtkDataSet.h"
+#include "vtkIdList.h"
+#include "vtkIdTypeArray.h"
+#include "vtkMath.h"
+#include "vtkMatrix4x4.h"
+#include "vtkObjectFactory.h"
+#include "vtkSMPThreadLocalObject.h"
+#include "vtkSMPTools.h"
+
+#include <cmath>
+
+namespace
+{
+	//----------------------------------------------------------------------------
+	struct vtkComputeCentroids
+	{
+		vtkDataSet* Input;
+		float* Centroids;
+		vtkSMPThreadLocalObject<vtkIdList> PointIds;
+
+		void Initialize() {}
+
+		void operator()(vtkIdType begin, vtkIdType end)
+		{
+			vtkIdList* ptIds = this->PointIds.Local();
+			for (vtkIdType cellId = begin; cellId < end; cellId++)
+			{
+				this->Input->GetCellPoints(cellId, ptIds);
+				double center[3] = { 0., 0., 0. };
+				const vtkIdType nbPoints = ptIds->GetNumberOfIds();
+				for (vtkIdType i = 0; i < nbPoints; i++)
+				{
+					double pt[3];
+					this->Input->GetPoint(ptIds->GetId(i), pt);
+					center[0] += pt[0];
+					center[1] += pt[1];
+					center[2] += pt[2];
+				}
+				for (int c = 0; c < 3; c++)
+				{
+					this->Centroids[3 * cellId + c] =
+						static_cast<float>(nbPoints > 0 ? center[c] / nbPoints : 0.);
+				}
+			}
+		}
+
+		void Reduce() {}
+	};
+
+	//----------------------------------------------------------------------------
+	// Normalized device depth of the centroids
+	struct vtkComputeDepthKeys
+	{
+		const float* Centroids;
+		unsigned int* Keys;
+		float Matrix[2][4];
+
+		void operator()(vtkIdType begin, vtkIdType end) const
+		{
+			for (vtkIdType cellId = begin; cellId < end; cellId++)
+			{
+				const float* c = this->Centroids + 3 * cellId;
+				const float z = this->Matrix[0][0] * c[0] + this->Matrix[0][1] * c[1] +
+					this->Matrix[0][2] * c[2] + this->Matrix[0][3];
+				const float w = this->Matrix[1][0] * c[0] + this->Matrix[1][1] * c[1] +
+					this->Matrix[1][2] * c[2] + this->Matrix[1][3];
+				this->Keys[cellId] = vtkLIC3DRadixSort::FloatToKey(w != 0.f ? z / w : z);
+			}
+		}
+	};
+}
+
+vtkStandardNewMacro(vtkLIC3DCellDepthSort);
+
+//----------------------------------------------------------------------------
+vtkLIC3DCellDepthSort::vtkLIC3DCellDepthSort()
+{
+	this->MaximumIncrementalAngle = 2.;
+	this->CentroidsInput = 0;
+	this->LastViewDirection[0] = this->LastViewDirection[1] = this->LastViewDirection[2] = 0.;
+	this->LastParallelProjection = 0;
+	this->HasOrder = false;
+	this->NextCell = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkLIC3DCellDepthSort::~vtkLIC3DCellDepthSort()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DCellDepthSort::ComputeCentroids()
+{
+	const vtkIdType nbCells = this->Input->GetNumberOfCells();
+	this->Centroids.resize(3 * nbCells);
+	this->Keys.resize(nbCells);
+	this->SortedKeys.resize(nbCells);
+	this->SortedCells.resize(nbCells);
+	this->HasOrder = false;
+	if (nbCells == 0)
+	{
+		return;
+	}
+
+	// Make sure the dataset cell structures are built before reading them
+	// from several threads
+	vtkNew<vtkIdList> ptIds;
+	this->Input->GetCellPoints(0, ptIds.Get());
+
+	vtkComputeCentroids functor;
+	functor.Input = this->Input;
+	functor.Centroids = &this->Centroids[0];
+	vtkSMPTools::For(0, nbCells, functor);
+
+	this->CentroidsInput = this->Input;
+	this->CentroidsTime.Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkLIC3DCellDepthSort::InsertionSort()
+{
+	const vtkIdType nbCells = static_cast<vtkIdType>(this->SortedCells.size());
+	for (vtkIdType i = 0; i < nbCells; i++)
+	{
+		this->SortedKeys[i] = this->Keys[this->SortedCells[i]];
+	}
+
+	// A small camera move only swaps close cells, give up when the order
+	// changed too much for the insertion sort to be cheap
+	vtkIdType budget = 8 * nbCells;
+	for (vtkIdType i = 1; i < nbCells; i++)
+	{
+		const unsigned int key = this->SortedKeys[i];
+		const vtkIdType cellId = this->SortedCells[i];
+		vtkIdType j = i;
+		for (; j > 0 && this->SortedKeys[j - 1] > key; j--)
+		{
+			this->SortedKeys[j] = this->SortedKeys[j - 1];
+			this->SortedCells[j] = this->SortedCells[j - 1];
+		}
+		this->SortedKeys[j] = key;
+		this->SortedCells[j] = cellId;
+		budget -= i - j;
+		if (budget < 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DCellDepthSort::InitTraversal()
+{
+	this->NextCell = 0;
+	if (!this->Input || !this->Camera)
+	{
+		this->SortedCells.clear();
+		return;
+	}
+
+	if (this->Input != this->CentroidsInput || this->Input->GetMTime() > this->CentroidsTime)
+	{
+		this->ComputeCentroids();
+	}
+	const vtkIdType nbCells = static_cast<vtkIdType>(this->Centroids.size() / 3);
+	if (nbCells == 0)
+	{
+		return;
+	}
+
+	// Depths of the centroids from the composite projection of the model
+	vtkNew<vtkMatrix4x4> matrix;
+	vtkMatrix4x4::Multiply4x4(
+		this->Camera->GetCompositeProjectionTransformMatrix(1., -1., 1.), this->ModelTransform,
+		matrix.Get());
+	vtkComputeDepthKeys depths;
+	depths.Centroids = &this->Centroids[0];
+	depths.Keys = &this->Keys[0];
+	for (int j = 0; j < 4; j++)
+	{
+		depths.Matrix[0][j] = static_cast<float>(matrix->GetElement(2, j));
+		depths.Matrix[1][j] = static_cast<float>(matrix->GetElement(3, j));
+	}
+	vtkSMPTools::For(0, nbCells, depths);
+
+	// Direction of projection in model coordinates
+	double direction[4];
+	this->Camera->GetDirectionOfProjection(direction);
+	direction[3] = 0.;
+	this->InverseModelTransform->MultiplyPoint(direction, direction);
+	vtkMath::Normalize(direction);
+
+	const double cosAngle = vtkMath::Dot(direction, this->LastViewDirection);
+	const bool incremental = this->HasOrder &&
+		this->LastParallelProjection == this->Camera->GetParallelProjection() &&
+		cosAngle >= std::cos(vtkMath::RadiansFromDegrees(this->MaximumIncrementalAngle));
+	if (!incremental || !this->InsertionSort())
+	{
+		for (vtkIdType i = 0; i < nbCells; i++)
+		{
+			this->SortedCells[i] = i;
+		}
+		std::copy(this->Keys.begin(), this->Keys.end(), this->SortedKeys.begin());
+		this->RadixSort.Sort(nbCells, &this->SortedKeys[0], &this->SortedCells[0]);
+	}
+
+	this->LastViewDirection[0] = direction[0];
+	this->LastViewDirection[1] = direction[1];
+	this->LastViewDirection[2] = direction[2];
+	this->LastParallelProjection = this->Camera->GetParallelProjection();
+	this->HasOrder = true;
+	this->LastSortTime.Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkIdTypeArray* vtkLIC3DCellDepthSort::GetNextCells()
+{
+	const vtkIdType nbCells = static_cast<vtkIdType>(this->SortedCells.size());
+	if (this->NextCell >= nbCells)
+	{
+		return 0;
+	}
+
+	const vtkIdType count = std::min<vtkIdType>(this->MaxCellsReturned, nbCells - this->NextCell);
+	this->CellIds->SetNumberOfTuples(count);
+	vtkIdType* ids = this->CellIds->GetPointer(0);
+	if (this->Direction == vtkVisibilitySort::BACK_TO_FRONT)
+	{
+		// Larger depths are farther
+		for (vtkIdType i = 0; i < count; i++)
+		{
+			ids[i] = this->SortedCells[nbCells - 1 - this->NextCell - i];
+		}
+	}
+	else
+	{
+		std::copy(this->SortedCells.begin() + this->NextCell,
+			this->SortedCells.begin() + this->NextCell + count, ids);
+	}
+	this->NextCell += count;
+	return this->CellIds.Get();
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DCellDepthSort::PrintSelf(ostream& os, vtkIndent indent)
+{
+	this->Superclass::PrintSelf(os, indent);
+	os << indent << "MaximumIncrementalAngle: " << this->MaximumIncrementalAngle << endl;
+}
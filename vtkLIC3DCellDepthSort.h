@@ -0,0 +1,81 @@
+/**
+* @class   vtkLIC3DCellDepthSort
+* @brief   parallel depth sort of cells by their centroid
+*
+* vtkLIC3DCellDepthSort orders the cells of its input by the depth of their
+* centroid, like vtkCellCenterDepthSort, for the projected tetrahedra mapper.
+* The centroids are only computed when the input changes, and the depths are
+* computed and radix sorted in parallel with vtkSMPTools.
+*
+* When the view direction changes by less than MaximumIncrementalAngle, the
+* previous order is almost right and is fixed by an insertion sort instead,
+* which falls back to the radix sort if too many cells move.
+*/
+
+#ifndef vtkLIC3DCellDepthSort_h
+#define vtkLIC3DCellDepthSort_h
+
+#include "vtkVisibilitySort.h"
+
+#include "vtkLIC3DRadixSort.h" // for vtkLIC3DRadixSort
+#include "vtkNew.h"            // for vtkNew
+#include "vtkTimeStamp.h"      // for vtkTimeStamp
+
+#include <vector> // for std::vector
+
+class vtkIdTypeArray;
+
+class VTK_EXPORT vtkLIC3DCellDepthSort : public vtkVisibilitySort
+{
+public:
+	static vtkLIC3DCellDepthSort* New();
+	vtkTypeMacro(vtkLIC3DCellDepthSort, vtkVisibilitySort);
+	void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+	void InitTraversal() VTK_OVERRIDE;
+	vtkIdTypeArray* GetNextCells() VTK_OVERRIDE;
+
+	//@{
+	/**
+	* Get/Set the maximum change of the view direction (in degrees) for which
+	* the previous order is updated instead of sorted again. 0 always sorts
+	* again. Default is 2.
+	*/
+	vtkSetClampMacro(MaximumIncrementalAngle, double, 0., 180.);
+	vtkGetMacro(MaximumIncrementalAngle, double);
+	//@}
+
+protected:
+	vtkLIC3DCellDepthSort();
+	~vtkLIC3DCellDepthSort() override;
+
+	void ComputeCentroids();
+	bool InsertionSort();
+
+	double MaximumIncrementalAngle;
+
+	// Centroids of the input cells, updated with the input
+	std::vector<float> Centroids;
+	vtkDataSet* CentroidsInput;
+	vtkTimeStamp CentroidsTime;
+
+	// Depth key of each cell, and the cells in depth order
+	std::vector<unsigned int> Keys;
+	std::vector<unsigned int> SortedKeys;
+	std::vector<vtkIdType> SortedCells;
+	vtkLIC3DRadixSort RadixSort;
+
+	// View of the last sort, used to decide for an incremental sort
+	double LastViewDirection[3];
+	int LastParallelProjection;
+	bool HasOrder;
+
+	vtkIdType NextCell;
+	vtkNew<vtkIdTypeArray> CellIds;
+
+private:
+	vtkLIC3DCellDepthSort(const vtkLIC3DCellDepthSort&) = delete;
+	void operator=(const vtkLIC3DCellDepthSort&) = delete;
+};
+
+#endif
@@ -5,14 +5,23 @@
 #include "vtkCellArray.h"
 #include "vtkCellData.h"
 #include "vtkCellLocator.h"
+#include "vtkCommunicator.h"
+#include "vtkCompositeDataIterator.h"
+#include "vtkCompositeDataSet.h"
 #include "vtkDataArray.h"
 #include "vtkDataSet.h"
 #include "vtkExecutive.h"
+#include "vtkFloatArray.h"
 #include "vtkGenericCell.h"
+#include "vtkIdList.h"
+#include "vtkImageData.h"
 #include "vtkInformation.h"
+#include "vtkLIC3DRadixSort.h"
 #include "vtkMath.h"
 #include "vtkMatrix4x4.h"
 #include "vtkMinimalStandardRandomSequence.h"
+#include "vtkMultiProcessController.h"
+#include "vtkMultiThreader.h"
 #include "vtkNew.h"
 #include "vtkObjectFactory.h"
 #include "vtkOpenGLActor.h"
@@ -20,32 +29,43 @@
 #include "vtkOpenGLCamera.h"
 #include "vtkOpenGLError.h"
 #include "vtkOpenGLFramebufferObject.h"
-#include "vtkOpenGLRenderUtilities.h"
 #include "vtkOpenGLRenderWindow.h"
 #include "vtkOpenGLRenderer.h"
 #include "vtkOpenGLShaderCache.h"
 #include "vtkOpenGLTexture.h"
 #include "vtkOpenGLVertexArrayObject.h"
-#include "vtkOpenGLVertexBufferObjectGroup.h"
 #include "vtkPointData.h"
 #include "vtkPoints.h"
 #include "vtkPolyData.h"
 #include "vtkProperty.h"
 #include "vtkRenderWindow.h"
+#include "vtkSMPThreadLocal.h"
+#include "vtkSMPTools.h"
 #include "vtkScalarsToColors.h"
 #include "vtkShader.h"
 #include "vtkShaderProgram.h"
 #include "vtkSmartPointer.h"
+#include "vtkTetra.h"
 #include "vtkTextureObject.h"
 #include "vtkTextureObjectVS.h" // a pass through shader
+#include "vtkTimeStamp.h"
+#include "vtkTimerLog.h"
+#include "vtkUniformGridAMRDataIterator.h"
+#include "vtkUnsignedCharArray.h"
+#include "vtkVoxel.h"
+#include "vtkZLibDataCompressor.h"
 
 #include "vtk_glew.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <vector>
 
 extern const char* vtkStreamLinesBlending_fs;
 extern const char* vtkStreamLinesCopy_fs;
+extern const char* vtkStreamLinesReproject_fs;
+extern const char* vtkStreamLinesReproject_vs;
 extern const char* vtkStreamLines_fs;
 extern const char* vtkStreamLines_gs;
 extern const char* vtkStreamLines_vs;
@@ -75,75 +95,336 @@ public:
 
 	void ReleaseGraphicsResources(vtkWindow* renWin)
 	{
-		RELEASE_VTKGL_OBJECT(this->VBOs);
+		this->ReleaseDrawChunks();
+		RELEASE_VTKGL_OBJECT2(this->QuadBuffer);
+		RELEASE_VTKGL_OBJECT2(this->SegmentsVAO);
+		RELEASE_VTKGL_OBJECT2(this->BlendingVAO);
+		RELEASE_VTKGL_OBJECT2(this->TextureVAO);
+		RELEASE_VTKGL_OBJECT2(this->ReprojectVAO);
 		RELEASE_VTKGL_OBJECT(this->BlendingProgram);
+		RELEASE_VTKGL_OBJECT(this->CompositeTexture);
 		RELEASE_VTKGL_OBJECT(this->CurrentBuffer);
+		RELEASE_VTKGL_OBJECT(this->CurrentDepthTexture);
 		RELEASE_VTKGL_OBJECT(this->CurrentTexture);
 		RELEASE_VTKGL_OBJECT(this->FrameBuffer);
+		RELEASE_VTKGL_OBJECT(this->FrameDepthTexture);
 		RELEASE_VTKGL_OBJECT(this->FrameTexture);
 		RELEASE_VTKGL_OBJECT(this->Program);
+		RELEASE_VTKGL_OBJECT(this->ReprojectBuffer);
+		RELEASE_VTKGL_OBJECT(this->ReprojectDepthTexture);
+		RELEASE_VTKGL_OBJECT(this->ReprojectProgram);
+		RELEASE_VTKGL_OBJECT(this->ReprojectTexture);
 		RELEASE_VTKGL_OBJECT(this->TextureProgram);
-		RELEASE_VTKGL_OBJECT2(this->IndexBufferObject);
+		this->HasTrailHistory = false;
+		this->HasCompositeTrails = false;
 	}
 
 	void SetMapper(vtkLIC3DMapper* mapper) { this->Mapper = mapper; }
 
-	void SetNumberOfParticles(int);
+	void SetNumberOfParticles(vtkIdType);
 
-	void SetData(vtkDataSet*, vtkDataArray*, vtkDataArray*);
+	bool SetData(vtkDataObject*);
+
+	// Share the particles between the processes, a collective operation.
+	// Return whether any process has data.
+	bool UpdateDistribution(bool);
+
+	bool IsDistributed()
+	{
+		return this->Mapper->Controller && this->Mapper->Controller->GetNumberOfProcesses() > 1;
+	}
+
+	vtkIdType GetNumberOfReceivedParticles() { return this->NumberOfReceivedParticles; }
 
 	void DrawParticles(vtkRenderer*, vtkActor*, bool);
 
+	// Composite the trails of all the processes, a collective operation
+	void CompositeTrails(vtkRenderer*, bool);
+
+	// Draw the trails of the last CompositeTrails(), without communicating
+	void PresentCompositeTrails();
+
 	void UpdateParticles();
 
+	void EncodeParticles(vtkUnsignedCharArray*);
+	bool DecodeParticles(vtkUnsignedCharArray*);
+
+	// Return whether a stream was decoded since the last call
+	bool ConsumeDecodedParticles()
+	{
+		const bool decoded = this->HasDecodedParticles;
+		this->HasDecodedParticles = false;
+		return decoded;
+	}
+
+	bool HasDecodedStream() { return !this->StreamPositions.empty(); }
+
+	bool GetParticleSegment(vtkIdType, double[3], double[3]);
+	bool SetParticleSegment(vtkIdType, const double[3], const double[3]);
+
 protected:
 	Private();
 	~Private() override;
 
-	void InitParticle(int);
-	bool PrepareGLBuffers(vtkRenderer*, vtkActor*);
-	bool InterpolateSpeedAndColor(double[3], double[3], vtkIdType);
+	// A dataset of the input, with its arrays and its own interpolation
+	// structure chosen from its type
+	struct Block
+	{
+		vtkDataSet* DataSet;
+		// Arrays sampled by the particles: the arrays of the input, or their
+		// copies placed on the threads with NUMAPlacement
+		vtkDataArray* Vectors;
+		vtkDataArray* Scalars;
+		vtkDataArray* InputVectors;
+		vtkDataArray* InputScalars;
+		vtkSmartPointer<vtkDataArray> PlacedVectors;
+		vtkSmartPointer<vtkDataArray> PlacedScalars;
+		vtkUnsignedCharArray* Ghosts;
+		// Set for 3D images (and AMR boxes) whose cells are found by direct
+		// indexing
+		vtkImageData* Image;
+		// Not needed by images and rectilinear grids, which find their cells
+		// from their structure
+		vtkSmartPointer<vtkCellLocator> Locator;
+		double Bounds[6];
+		// AMR level of the block, 0 for other datasets
+		int Level;
+		// Ghost types of the cells that must not be sampled in this block
+		unsigned char GhostMask;
+		bool AreCellVectors;
+		bool AreCellScalars;
+	};
+
+	// Node of the bounding box tree over the blocks, leaves reference a block
+	struct BoundsNode
+	{
+		double Bounds[6];
+		int Children[2];
+		int Block;
+	};
 
-	inline double Rand(double vmin = 0., double vmax = 1.)
+	// State of a thread advecting particles
+	struct Scratch
 	{
-		this->RandomNumberSequence->Next();
-		return this->RandomNumberSequence->GetRangeValue(vmin, vmax);
+		vtkSmartPointer<vtkGenericCell> Cell;
+		vtkSmartPointer<vtkIdList> PointIds;
+		vtkSmartPointer<vtkMinimalStandardRandomSequence> Random;
+		std::vector<double> Weights;
+		std::vector<double> Tuple;
+		std::vector<int> NodeStack;
+		// Slots of the particle rings written by the thread
+		bool WrittenSlots[2];
+		// Particles which died or left the local data
+		std::vector<vtkIdType> FreeSlots;
+		std::vector<double> SendBuffer;
+
+		double Rand(double vmin = 0., double vmax = 1.)
+		{
+			this->Random->Next();
+			return this->Random->GetRangeValue(vmin, vmax);
+		}
+	};
+
+	Scratch& GetScratch();
+
+	// Slot of the current position of a particle, and of the previous one,
+	// the same when its segment just started
+	int GetHead(vtkIdType pid) { return this->ParticlesRing[pid] & 1; }
+	int GetTail(vtkIdType pid)
+	{
+		const unsigned char ring = this->ParticlesRing[pid];
+		return (ring & RingHasPrevious) ? 1 - (ring & 1) : (ring & 1);
 	}
+	void AdvanceRing(vtkIdType, const double[3], bool, Scratch&);
+	void MarkWrittenSlots();
+	void ReleaseDrawChunks();
+	void UpdateParticles(vtkIdType, vtkIdType, int, Scratch&);
+	void InitParticle(vtkIdType, Scratch&);
+	void ResizeParticles(vtkIdType);
+	vtkIdType GetLocalNumberOfParticles();
+	vtkIdType GetNumberOfActiveParticles();
+	int GetUpdatePeriod();
+	unsigned long EstimateMemorySize(vtkIdType);
+	void ComputeSegmentsFade(int);
+	bool UpdatePositionQuantization();
+	bool PrepareGLBuffers(vtkRenderer*, vtkActor*);
+	bool InterpolateSpeedAndColor(
+		double[3], double[3], vtkIdType, int, Scratch&, unsigned char = 0);
+	void AddBlock(vtkDataSet*, int, std::vector<Block>&);
+	void PlaceBlockArrays();
+	int GetNumberOfPlacementRanges();
+	int BuildBoundsTree(const std::vector<double>&, std::vector<int>::iterator,
+		std::vector<int>::iterator, std::vector<BoundsNode>&);
+	vtkIdType FindCell(int, double[3], double[3], Scratch&, unsigned char = 0);
+	int LocateBlock(double[3], int, vtkIdType&, double[3], Scratch&, unsigned char = 0);
+	double ComputeOwnedVolume(const Block&);
+	bool IsInRemoteBlock(const double[3], Scratch&);
+	void SendParticle(vtkIdType, const double[3], Scratch&);
+	void ExchangeParticles();
+	void SortParticles();
+	void DrawSegments(vtkRenderer*, vtkActor*, vtkMatrix4x4*);
+	void AccumulateSegments(vtkOpenGLRenderWindow*);
+	void WarmUpTrails(vtkRenderer*, vtkActor*, vtkMatrix4x4*);
+	bool IsSmallCameraChange(vtkCamera*);
+	void SaveCameraState(vtkCamera*, vtkMatrix4x4*);
+	void ReprojectTrails(vtkOpenGLRenderWindow*, vtkMatrix4x4*);
+	void GetBufferSize(vtkRenderer*, unsigned int&, unsigned int&);
+	void PresentTrails(vtkTextureObject*);
+	void RenderQuad(vtkShaderProgram*, vtkOpenGLVertexArrayObject*&);
+	void MapChunkColors(vtkScalarsToColors*, int, vtkIdType, vtkIdType);
+	void GetCompositeRegion(int, int, vtkIdType, vtkIdType&, vtkIdType&);
 
-	vtkCellLocator* Locator;
-	vtkOpenGLBufferObject* IndexBufferObject;
 	vtkOpenGLFramebufferObject* CurrentBuffer;
 	vtkOpenGLFramebufferObject* FrameBuffer;
+	vtkOpenGLFramebufferObject* ReprojectBuffer;
 	vtkOpenGLShaderCache* ShaderCache;
-	vtkOpenGLVertexBufferObjectGroup* VBOs;
+	vtkOpenGLBufferObject* QuadBuffer;
+	// Vertex arrays of the passes, kept between frames like their buffers so
+	// that a frame does not allocate any
+	vtkOpenGLVertexArrayObject* SegmentsVAO;
+	vtkOpenGLVertexArrayObject* BlendingVAO;
+	vtkOpenGLVertexArrayObject* TextureVAO;
+	vtkOpenGLVertexArrayObject* ReprojectVAO;
 	vtkShaderProgram* BlendingProgram;
 	vtkShaderProgram* Program;
+	vtkShaderProgram* ReprojectProgram;
 	vtkShaderProgram* TextureProgram;
-	vtkSmartPointer<vtkMinimalStandardRandomSequence> RandomNumberSequence;
 	vtkLIC3DMapper* Mapper;
+	vtkTextureObject* CompositeTexture;
+	vtkTextureObject* CurrentDepthTexture;
 	vtkTextureObject* CurrentTexture;
+	vtkTextureObject* FrameDepthTexture;
 	vtkTextureObject* FrameTexture;
+	vtkTextureObject* ReprojectDepthTexture;
+	vtkTextureObject* ReprojectTexture;
 	vtkNew<vtkMatrix4x4> TempMatrix4;
+	vtkNew<vtkMatrix4x4> ReprojectionMatrix;
+
+	// Camera used to accumulate the trails, needed to reproject them
+	vtkNew<vtkMatrix4x4> LastWCDC;
+	double LastCameraPosition[3];
+	double LastCameraFocalPoint[3];
+	double LastViewAngle;
+	double LastParallelScale;
 
 	double Bounds[6];
-	std::vector<int> Indices;
 	std::vector<int> ParticlesTTL;
-	vtkDataArray* InterpolationArray;
-	vtkDataArray* Scalars;
-	vtkDataArray* Vectors;
-	vtkDataSet* DataSet;
+	// Block each particle was last found in, -1 if unknown
+	std::vector<int> ParticlesBlock;
+	// Step each particle was last advected or seeded at, and the fade of its
+	// segment ends when only a fraction of them is advected at each step
+	std::vector<vtkIdType> ParticlesStep;
+	vtkNew<vtkFloatArray> SegmentsFade;
+	// Positions and scalars of the particles at their last two updates: each
+	// particle has a ring of two slots, so that an update only writes its new
+	// position. ParticlesRing holds the slot of the current position, plus
+	// RingHasPrevious when the other slot holds the previous one.
+	enum
+	{
+		RingHasPrevious = 2
+	};
+	vtkNew<vtkPoints> Positions[2];
+	vtkSmartPointer<vtkDataArray> Scalars[2];
+	std::vector<unsigned char> ParticlesRing;
+	// Buffers of the chunks of particles drawn at once, with both slots of
+	// their rings, each slot uploaded again only once written. The ring and
+	// fade buffers are uploaded at every step, per chunk so that each keeps
+	// its size and the GL reuses its storage.
+	struct DrawChunk
+	{
+		vtkOpenGLBufferObject* Positions[2];
+		vtkOpenGLBufferObject* Colors[2];
+		vtkOpenGLBufferObject* Ring;
+		vtkOpenGLBufferObject* Fade;
+		vtkTimeStamp UploadTime[2];
+		bool HasColors[2];
+		vtkIdType First;
+		vtkIdType Count;
+	};
+	std::vector<DrawChunk> DrawChunks;
+	// Colors of a chunk slot
+	vtkNew<vtkUnsignedCharArray> ChunkColors;
+	// Positions of a chunk slot quantized to 16 bits over QuantizationBounds,
+	// the slots being uploaded again when the quantization changes
+	std::vector<unsigned short> QuantizedPoints;
+	double QuantizationBounds[6];
+	bool QuantizedUpload;
+	vtkTimeStamp QuantizationTime;
+	// Smallest spacing of the image blocks and bounding box edge of the cells
+	// of the other blocks, 0 if unknown
+	double MinimumCellSize;
+	// Largest vector norm of the blocks
+	double MaximumSpeed;
+	std::vector<Block> Blocks;
+	std::vector<BoundsNode> BoundsTree;
+	std::vector<double> ScalarTuple;
+	std::vector<double> MissingScalarTuple;
+	vtkTimeStamp BlocksBuildTime;
+	// Input the blocks were last checked against, and when
+	vtkDataObject* CheckedInput;
+	vtkTimeStamp CheckTime;
+
+	// Distribution of the particles over the processes: the volume of the
+	// cells owned by this process and by all of them, the bounds of the blocks
+	// of the other processes, and the particles leaving the local data
+	vtkIdType NumberOfRequestedParticles;
+	double LocalVolume;
+	double GlobalVolume;
+	std::vector<double> RemoteBounds;
+	std::vector<BoundsNode> RemoteBoundsTree;
+	// Records of a position, a time to live and a (padded) scalar tuple
+	int RecordSize;
+	std::vector<double> SendBuffer;
+	std::vector<double> ReceiveBuffer;
+	std::vector<vtkIdType> ReceiveLengths;
+	std::vector<vtkIdType> ReceiveOffsets;
+	std::vector<vtkIdType> FreeSlots;
+	// Particles received since the last distribution
+	vtkIdType NumberOfReceivedParticles;
+	// Quantized particle ends and scalars of the last encoded or decoded
+	// stream, which the next one is delta encoded against
+	std::vector<unsigned short> StreamPositions;
+	std::vector<unsigned short> StreamScalars;
+	std::vector<unsigned char> StreamBuffer;
+	double StreamBounds[6];
+	int StreamFrame;
+	bool HasDecodedParticles;
+	// Morton codes of the particles and the order sorting them
+	vtkLIC3DRadixSort RadixSort;
+	std::vector<unsigned int> SortKeys;
+	std::vector<vtkIdType> SortOrder;
+	std::vector<float> SortedPoints;
+	std::vector<unsigned char> SortedRing;
+	std::vector<int> SortedTTL;
+	std::vector<int> SortedBlocks;
+	std::vector<vtkIdType> SortedSteps;
+	vtkSmartPointer<vtkDataArray> SortedScalars[2];
+	// Trails of all the processes, composited by binary swap
+	std::vector<unsigned char> CompositeImage;
+	std::vector<unsigned char> CompositePiece;
+	std::vector<vtkIdType> CompositeLengths;
+	std::vector<vtkIdType> CompositeOffsets;
+	// Ghost types of the cells which are not seeded, on top of the blocks mask
+	unsigned char SeedGhostMask;
+	vtkTimeStamp DistributionTime;
 	vtkNew<vtkGenericCell> GenericCell;
 	vtkNew<vtkIdList> IdList;
-	vtkNew<vtkPoints> Particles;
-	vtkSmartPointer<vtkDataArray> InterpolationScalarArray;
+	vtkSMPThreadLocal<Scratch> Scratches;
+	// Seeds are drawn from the random seed, the step and the particle, which
+	// does not depend on the threads
+	int RandomSeed;
+	vtkIdType Step;
 	vtkMTimeType ActorMTime;
 	vtkMTimeType CameraMTime;
 
-	bool AreCellScalars;
-	bool AreCellVectors;
+	bool HasScalars;
+	// Whether the arrays of the blocks are copies placed on the threads
+	bool PlacedArrays;
 	bool ClearFlag;
-	bool RebuildBufferObjects;
+	bool WarmUpPending;
 	bool CreateWideLines;
+	bool HasTrailHistory;
+	bool HasCompositeTrails;
 
 private:
 	Private(const Private&) = delete;
@@ -156,585 +437,2669 @@ vtkStandardNewMacro(vtkLIC3DMapper::Private)
 vtkLIC3DMapper::Private::Private()
 {
 	this->Mapper = 0;
-	this->RandomNumberSequence = vtkSmartPointer<vtkMinimalStandardRandomSequence>::New();
-	this->RandomNumberSequence->SetSeed(1);
-	this->VBOs = 0;
+	this->RandomSeed = 1;
+	this->Step = 0;
+	this->QuadBuffer = 0;
+	this->SegmentsVAO = 0;
+	this->BlendingVAO = 0;
+	this->TextureVAO = 0;
+	this->ReprojectVAO = 0;
 	this->ShaderCache = 0;
 	this->CurrentBuffer = 0;
 	this->FrameBuffer = 0;
+	this->CompositeTexture = 0;
+	this->ReprojectBuffer = 0;
 	this->CurrentTexture = 0;
+	this->CurrentDepthTexture = 0;
 	this->FrameTexture = 0;
+	this->FrameDepthTexture = 0;
+	this->ReprojectTexture = 0;
+	this->ReprojectDepthTexture = 0;
 	this->Program = 0;
 	this->BlendingProgram = 0;
+	this->ReprojectProgram = 0;
 	this->TextureProgram = 0;
-	this->IndexBufferObject = 0;
-	this->Particles->SetDataTypeToFloat();
-	this->RebuildBufferObjects = true;
-	this->InterpolationArray = 0;
-	this->InterpolationScalarArray = 0;
-	this->Vectors = 0;
-	this->Scalars = this->Particles->GetData();
-	this->DataSet = 0;
+	this->Positions[0]->SetDataTypeToFloat();
+	this->Positions[1]->SetDataTypeToFloat();
+	this->ChunkColors->SetNumberOfComponents(4);
+	this->CheckedInput = 0;
+	this->HasScalars = false;
+	this->PlacedArrays = false;
 	this->ClearFlag = true;
-	this->RebuildBufferObjects = true;
-	this->Locator = 0;
+	this->WarmUpPending = true;
 	this->ActorMTime = 0;
 	this->CameraMTime = 0;
-	this->AreCellVectors = false;
-	this->AreCellScalars = false;
 	this->CreateWideLines = false;
+	this->HasTrailHistory = false;
+	this->HasCompositeTrails = false;
+	this->LastCameraPosition[0] = this->LastCameraPosition[1] = this->LastCameraPosition[2] = 0.;
+	this->LastCameraFocalPoint[0] = this->LastCameraFocalPoint[1] = this->LastCameraFocalPoint[2] = 0.;
+	this->LastViewAngle = 0.;
+	this->LastParallelScale = 0.;
+	this->NumberOfRequestedParticles = 0;
+	this->LocalVolume = 0.;
+	this->GlobalVolume = 0.;
+	this->RecordSize = 5;
+	this->NumberOfReceivedParticles = 0;
+	this->SeedGhostMask = 0;
+	this->StreamBounds[0] = this->StreamBounds[2] = this->StreamBounds[4] = 0.;
+	this->StreamBounds[1] = this->StreamBounds[3] = this->StreamBounds[5] = 0.;
+	this->StreamFrame = 0;
+	this->HasDecodedParticles = false;
+	vtkMath::UninitializeBounds(this->QuantizationBounds);
+	this->QuantizedUpload = false;
+	this->MinimumCellSize = 0.;
+	this->MaximumSpeed = 0.;
 }
 
 //----------------------------------------------------------------------------
 vtkLIC3DMapper::Private::~Private()
 {
-	if (this->InterpolationArray)
-	{
-		this->InterpolationArray->Delete();
-		this->InterpolationArray = 0;
-	}
-	if (this->InterpolationScalarArray)
-	{
-		this->InterpolationScalarArray->Delete();
-		this->InterpolationScalarArray = 0;
-	}
-	if (this->Locator)
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::SetNumberOfParticles(vtkIdType nbParticles)
+{
+	this->NumberOfRequestedParticles = nbParticles;
+	this->ResizeParticles(this->GetLocalNumberOfParticles());
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkLIC3DMapper::Private::GetLocalNumberOfParticles()
+{
+	if (!this->IsDistributed() || this->GlobalVolume <= 0.)
 	{
-		this->Locator->Delete();
+		return this->NumberOfRequestedParticles;
 	}
+	return static_cast<vtkIdType>(
+		std::floor(this->NumberOfRequestedParticles * this->LocalVolume / this->GlobalVolume + 0.5));
 }
 
 //----------------------------------------------------------------------------
-void vtkLIC3DMapper::Private::SetNumberOfParticles(int nbParticles)
+void vtkLIC3DMapper::Private::ResizeParticles(vtkIdType nbParticles)
 {
-	this->Particles->SetNumberOfPoints(nbParticles * 2);
 	this->ParticlesTTL.resize(nbParticles, 0);
-	this->Indices.resize(nbParticles * 2);
-	if (this->InterpolationScalarArray)
+	this->ParticlesBlock.resize(nbParticles, -1);
+	this->ParticlesStep.resize(nbParticles, 0);
+	this->ParticlesRing.resize(nbParticles, 0);
+	for (int slot = 0; slot < 2; slot++)
+	{
+		this->Positions[slot]->SetNumberOfPoints(nbParticles);
+		this->Positions[slot]->Modified();
+		if (this->Scalars[slot])
+		{
+			this->Scalars[slot]->SetNumberOfTuples(nbParticles);
+			this->Scalars[slot]->Modified();
+		}
+	}
+}
+
+namespace
+{
+	//----------------------------------------------------------------------------
+	// Interpolate a tuple of any array type, blocks may store their arrays with
+	// different types
+	void InterpolateTuple(vtkDataArray* array, vtkIdList* ptIds, double* weights, double* tuple)
+	{
+		const int nbComp = array->GetNumberOfComponents();
+		std::fill(tuple, tuple + nbComp, 0.);
+		for (vtkIdType i = 0; i < ptIds->GetNumberOfIds(); i++)
+		{
+			const vtkIdType ptId = ptIds->GetId(i);
+			for (int c = 0; c < nbComp; c++)
+			{
+				tuple[c] += weights[i] * array->GetComponent(ptId, c);
+			}
+		}
+	}
+
+	//----------------------------------------------------------------------------
+	// Find the voxel of a 3D image containing a position from the image origin
+	// and spacing only, much cheaper than the generic FindCell()
+	vtkIdType FindVoxel(vtkImageData* image, const double pos[3], double pcoords[3], double* weights)
+	{
+		const double* origin = image->GetOrigin();
+		const double* spacing = image->GetSpacing();
+		const int* extent = image->GetExtent();
+		int ijk[3];
+		int nbCells[3];
+		for (int a = 0; a < 3; a++)
+		{
+			nbCells[a] = extent[2 * a + 1] - extent[2 * a];
+			const double x = (pos[a] - origin[a]) / spacing[a] - extent[2 * a];
+			if (x < 0. || x > nbCells[a])
+			{
+				return -1;
+			}
+			ijk[a] = std::min(static_cast<int>(x), nbCells[a] - 1);
+			pcoords[a] = x - ijk[a];
+		}
+		vtkVoxel::InterpolationFunctions(pcoords, weights);
+		return ijk[0] + nbCells[0] * (ijk[1] + static_cast<vtkIdType>(nbCells[1]) * ijk[2]);
+	}
+
+	//----------------------------------------------------------------------------
+	inline bool IsInBounds(const double pos[3], const double bounds[6])
+	{
+		return pos[0] >= bounds[0] && pos[0] <= bounds[1] && pos[1] >= bounds[2] &&
+			pos[1] <= bounds[3] && pos[2] >= bounds[4] && pos[2] <= bounds[5];
+	}
+
+	//----------------------------------------------------------------------------
+	// Additive compositing of premultiplied colors: the particles of the
+	// processes are disjoint, their trails simply add up
+	void AddPremultiplied(unsigned char* image, const unsigned char* piece, vtkIdType length)
+	{
+		for (vtkIdType i = 0; i < length; i++)
+		{
+			image[i] = static_cast<unsigned char>(std::min(255, image[i] + piece[i]));
+		}
+	}
+
+	const int vtkLICCompositeTag = 2017;
+
+	//----------------------------------------------------------------------------
+	// Scalars used directly as colors, converted to RGBA like
+	// vtkScalarsToColors::ConvertToRGBA() does: 1 component is a luminance, 2 a
+	// luminance and an opacity, 3 RGB and 4 RGBA, scaled from [0, 1] for
+	// floating point types
+	template <typename T>
+	void DirectColorsToRGBA(
+		const T* in, unsigned char* out, vtkIdType count, int nbComp, double scale, double alpha)
+	{
+		for (vtkIdType i = 0; i < count; i++, in += nbComp, out += 4)
+		{
+			double rgba[4];
+			for (int c = 0; c < 3; c++)
+			{
+				rgba[c] = scale * static_cast<double>(in[nbComp < 3 ? 0 : c]);
+			}
+			rgba[3] = 255.;
+			if (nbComp == 2 || nbComp >= 4)
+			{
+				rgba[3] = scale * static_cast<double>(in[nbComp == 2 ? 1 : 3]);
+			}
+			rgba[3] *= alpha;
+			for (int c = 0; c < 4; c++)
+			{
+				out[c] = static_cast<unsigned char>(std::min(255., std::max(0., rgba[c] + 0.5)));
+			}
+		}
+	}
+
+	//----------------------------------------------------------------------------
+	// Spread the 10 lowest bits of a value every 3 bits, to interleave them in
+	// a Morton code
+	inline unsigned int SpreadBits(unsigned int value)
+	{
+		value &= 0x3ff;
+		value = (value | (value << 16)) & 0x030000ff;
+		value = (value | (value << 8)) & 0x0300f00f;
+		value = (value | (value << 4)) & 0x030c30c3;
+		value = (value | (value << 2)) & 0x09249249;
+		return value;
+	}
+
+	//----------------------------------------------------------------------------
+	// Particle streams: values quantized to 16 bits, 65535 being kept for NaN
+	// scalars, and deltas written as zigzag varints
+	const int vtkLICStreamVersion = 2;
+
+	inline unsigned short Quantize(double value, double vmin, double vmax)
+	{
+		if (vtkMath::IsNan(value))
+		{
+			return 65535;
+		}
+		const double t = vmax > vmin ? (value - vmin) / (vmax - vmin) : 0.;
+		return static_cast<unsigned short>(std::floor(std::min(1., std::max(0., t)) * 65534. + 0.5));
+	}
+
+	inline double Dequantize(unsigned short value, double vmin, double vmax)
+	{
+		return value == 65535 ? vtkMath::Nan() : vmin + (vmax - vmin) * value / 65534.;
+	}
+
+	inline void WriteDelta(std::vector<unsigned char>& buffer, int delta)
+	{
+		unsigned int zigzag = (static_cast<unsigned int>(delta) << 1) ^ (delta < 0 ? ~0u : 0u);
+		while (zigzag >= 0x80)
+		{
+			buffer.push_back(static_cast<unsigned char>(zigzag | 0x80));
+			zigzag >>= 7;
+		}
+		buffer.push_back(static_cast<unsigned char>(zigzag));
+	}
+
+	inline bool ReadDelta(const unsigned char*& data, const unsigned char* end, int& delta)
 	{
-		this->InterpolationScalarArray->Resize(nbParticles * 2);
+		unsigned int zigzag = 0;
+		for (int shift = 0; data < end && shift < 32; shift += 7)
+		{
+			const unsigned char byte = *data++;
+			zigzag |= static_cast<unsigned int>(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+			{
+				delta = static_cast<int>(zigzag >> 1) ^ -static_cast<int>(zigzag & 1);
+				return true;
+			}
+		}
+		return false;
 	}
 
-	// Build indices array
-	for (int i = 0; i < nbParticles * 2; i++)
+	template <typename T>
+	void WriteValue(std::vector<unsigned char>& buffer, T value)
 	{
-		this->Indices[i] = i;
+		const std::size_t offset = buffer.size();
+		buffer.resize(offset + sizeof(T));
+		std::memcpy(&buffer[offset], &value, sizeof(T));
 	}
 
-	this->RebuildBufferObjects = true;
+	template <typename T>
+	bool ReadValue(const unsigned char*& data, const unsigned char* end, T& value)
+	{
+		if (end - data < static_cast<std::ptrdiff_t>(sizeof(T)))
+		{
+			return false;
+		}
+		std::memcpy(&value, data, sizeof(T));
+		data += sizeof(T);
+		return true;
+	}
 }
 
 //-----------------------------------------------------------------------------
-bool vtkLIC3DMapper::Private::InterpolateSpeedAndColor(
-	double pos[3], double outSpeed[3], vtkIdType pid)
+vtkIdType vtkLIC3DMapper::Private::FindCell(
+	int blockId, double pos[3], double pcoords[3], Scratch& scratch, unsigned char ghostMask)
 {
-	int subId;
-	double pcoords[3];
-	static double weights[1024];
+	if (blockId < 0)
+	{
+		return -1;
+	}
+	const Block& block = this->Blocks[blockId];
+	if (!::IsInBounds(pos, block.Bounds))
+	{
+		return -1;
+	}
 
-	vtkIdType cellId = 0;
-	if (!this->Locator)
+	double* weights = &scratch.Weights[0];
+	vtkIdType cellId;
+	if (block.Image)
+	{
+		cellId = ::FindVoxel(block.Image, pos, pcoords, weights);
+	}
+	else if (!block.Locator)
 	{
-		cellId = this->DataSet->FindCell(pos, 0, -1, 1e-10, subId, pcoords, weights);
+		int subId;
+		cellId = block.DataSet->FindCell(pos, 0, -1, 1e-10, subId, pcoords, weights);
 	}
 	else
 	{
-		cellId = this->Locator->FindCell(pos, 0., this->GenericCell.Get(), pcoords, weights);
+		cellId = block.Locator->FindCell(pos, 0., scratch.Cell, pcoords, weights);
 	}
 
-	if (cellId < 0)
+	if (cellId >= 0 && block.Ghosts &&
+		(block.Ghosts->GetValue(cellId) & (block.GhostMask | ghostMask)))
 	{
-		return false;
+		// Ghost cells are handled by the block owning them, and refined AMR
+		// cells by the finer boxes covering them
+		return -1;
 	}
+	return cellId;
+}
 
-	if (!this->Vectors && !this->Scalars)
+//-----------------------------------------------------------------------------
+int vtkLIC3DMapper::Private::LocateBlock(double pos[3], int skipBlock, vtkIdType& cellId,
+	double pcoords[3], Scratch& scratch, unsigned char ghostMask)
+{
+	cellId = -1;
+	if (this->BoundsTree.empty())
 	{
-		return true;
+		return -1;
 	}
 
-	this->DataSet->GetCellPoints(cellId, this->IdList.Get());
-	if (this->Vectors)
+	std::vector<int>& stack = scratch.NodeStack;
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty())
 	{
-		if (this->AreCellVectors)
+		const BoundsNode& node = this->BoundsTree[stack.back()];
+		stack.pop_back();
+		if (!::IsInBounds(pos, node.Bounds))
 		{
-			this->Vectors->GetTuple(cellId, outSpeed);
+			continue;
 		}
-		else
+		if (node.Block < 0)
 		{
-			this->InterpolationArray->InterpolateTuple(0, this->IdList.Get(), this->Vectors, weights);
-			this->InterpolationArray->GetTuple(0, outSpeed);
+			stack.push_back(node.Children[0]);
+			stack.push_back(node.Children[1]);
 		}
-		double speed = vtkMath::Norm(outSpeed);
-		if (speed == 0. || vtkMath::IsInf(speed) || vtkMath::IsNan(speed))
+		else if (node.Block != skipBlock)
 		{
-			// Null speed area
-			return false;
+			cellId = this->FindCell(node.Block, pos, pcoords, scratch, ghostMask);
+			if (cellId >= 0)
+			{
+				return node.Block;
+			}
 		}
 	}
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+bool vtkLIC3DMapper::Private::InterpolateSpeedAndColor(double pos[3], double outSpeed[3],
+	vtkIdType pid, int slot, Scratch& scratch, unsigned char ghostMask)
+{
+	double pcoords[3];
+
+	// Look in the block the particle was in first, then hand it off to the
+	// block containing its new position
+	int& blockId = this->ParticlesBlock[pid];
+	vtkIdType cellId = this->FindCell(blockId, pos, pcoords, scratch, ghostMask);
+	if (cellId < 0)
+	{
+		blockId = this->LocateBlock(pos, blockId, cellId, pcoords, scratch, ghostMask);
+	}
+
+	if (cellId < 0)
+	{
+		return false;
+	}
+
+	const Block& block = this->Blocks[blockId];
+	double* weights = &scratch.Weights[0];
+	block.DataSet->GetCellPoints(cellId, scratch.PointIds);
+	if (block.AreCellVectors)
+	{
+		block.Vectors->GetTuple(cellId, outSpeed);
+	}
+	else
+	{
+		::InterpolateTuple(block.Vectors, scratch.PointIds, weights, outSpeed);
+	}
+	double speed = vtkMath::Norm(outSpeed);
+	if (speed == 0. || vtkMath::IsInf(speed) || vtkMath::IsNan(speed))
+	{
+		// Null speed area
+		return false;
+	}
 
-	if (this->Scalars)
+	if (this->HasScalars)
 	{
-		if (this->AreCellScalars)
+		if (!block.Scalars)
 		{
-			this->InterpolationScalarArray->SetTuple(pid, this->Scalars->GetTuple(cellId));
+			this->Scalars[slot]->SetTuple(pid, &this->MissingScalarTuple[0]);
+		}
+		else if (block.AreCellScalars)
+		{
+			block.Scalars->GetTuple(cellId, &scratch.Tuple[0]);
+			this->Scalars[slot]->SetTuple(pid, &scratch.Tuple[0]);
 		}
 		else
 		{
-			this->InterpolationScalarArray->InterpolateTuple(
-				pid, this->IdList.Get(), this->Scalars, weights);
+			::InterpolateTuple(block.Scalars, scratch.PointIds, weights, &scratch.Tuple[0]);
+			this->Scalars[slot]->SetTuple(pid, &scratch.Tuple[0]);
 		}
 	}
 	return true;
 }
 
 //-----------------------------------------------------------------------------
-void vtkLIC3DMapper::Private::InitParticle(int pid)
+void vtkLIC3DMapper::Private::InitParticle(vtkIdType pid, Scratch& scratch)
 {
+	// Draw the same seed whatever the thread handling the particle
+	const vtkTypeUInt64 index = static_cast<vtkTypeUInt64>(pid);
+	vtkTypeUInt32 seed = static_cast<vtkTypeUInt32>(this->RandomSeed) * 2654435761u;
+	seed ^= static_cast<vtkTypeUInt32>(this->Step) * 2246822519u +
+		static_cast<vtkTypeUInt32>(index ^ (index >> 32)) * 3266489917u;
+	seed ^= seed >> 15;
+	scratch.Random->SetSeed(static_cast<int>(seed & 0x7fffffff) | 1);
+	this->ParticlesStep[pid] = this->Step;
+
+	// The seed starts a new segment in the free slot of the ring
+	const int slot = 1 - this->GetHead(pid);
 	bool added = false;
+	double pos[3];
 	do
 	{
 		// Sample a new seed location
-		double pos[3];
-		pos[0] = this->Rand(this->Bounds[0], this->Bounds[1]);
-		pos[1] = this->Rand(this->Bounds[2], this->Bounds[3]);
-		pos[2] = this->Rand(this->Bounds[4], this->Bounds[5]);
-		this->Particles->SetPoint(pid * 2 + 0, pos);
-		this->Particles->SetPoint(pid * 2 + 1, pos);
-		this->ParticlesTTL[pid] = this->Rand(1, this->Mapper->MaxTimeToLive);
-
-		// Check speed at this location
+		pos[0] = scratch.Rand(this->Bounds[0], this->Bounds[1]);
+		pos[1] = scratch.Rand(this->Bounds[2], this->Bounds[3]);
+		pos[2] = scratch.Rand(this->Bounds[4], this->Bounds[5]);
+		this->ParticlesTTL[pid] = scratch.Rand(1, this->Mapper->MaxTimeToLive);
+
+		// Check speed at this location, seeds are only taken in the cells owned
+		// by this process
 		double speedVec[9];
-		if (this->InterpolateSpeedAndColor(pos, speedVec, pid * 2))
+		if (this->InterpolateSpeedAndColor(pos, speedVec, pid, slot, scratch, this->SeedGhostMask))
 		{
-			this->InterpolationScalarArray->SetTuple(
-				pid * 2 + 1, this->InterpolationScalarArray->GetTuple(pid * 2));
 			double speed = vtkMath::Norm(speedVec);
 			// Do not sample in no-speed areas
 			added = (speed != 0. && !vtkMath::IsInf(speed) && !vtkMath::IsNan(speed));
 		}
 	} while (!added);
+	this->AdvanceRing(pid, pos, false, scratch);
 }
 
-//----------------------------------------------------------------------------
-void vtkLIC3DMapper::Private::UpdateParticles()
+//-----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::AdvanceRing(
+	vtkIdType pid, const double pos[3], bool continued, Scratch& scratch)
 {
-	const double dt = this->Mapper->StepLength;
-
-	int nbParticles = static_cast<int>(this->ParticlesTTL.size());
+	// The current position becomes the previous one, unless the segment starts
+	const int slot = 1 - this->GetHead(pid);
+	this->Positions[slot]->SetPoint(pid, pos);
+	this->ParticlesRing[pid] = static_cast<unsigned char>(slot | (continued ? RingHasPrevious : 0));
+	scratch.WrittenSlots[slot] = true;
+}
 
-	for (int i = 0; i < nbParticles; ++i)
+//-----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::MarkWrittenSlots()
+{
+	// Array modification times are not thread safe, the slots written by the
+	// threads are only marked once they are done
+	bool written[2] = { false, false };
+	for (vtkSMPThreadLocal<Scratch>::iterator it = this->Scratches.begin();
+		 it != this->Scratches.end(); ++it)
 	{
-		this->ParticlesTTL[i]--;
-		if (this->ParticlesTTL[i] > 0)
+		for (int slot = 0; slot < 2; slot++)
 		{
-			double pos[3];
-			this->Particles->GetPoint(i * 2 + 1, pos);
-
-			// Update prevpos with last pos
-			this->Particles->SetPoint(i * 2 + 0, pos);
-			this->InterpolationScalarArray->SetTuple(
-				i * 2 + 0, this->InterpolationScalarArray->GetTuple(i * 2 + 1));
-
-			// Move the particle and fetch its color
-			double speedVec[3];
-			if (this->InterpolateSpeedAndColor(pos, speedVec, i * 2 + 1))
-			{
-				this->Particles->SetPoint(2 * i + 1, pos[0] + dt * speedVec[0], pos[1] + dt * speedVec[1],
-					pos[2] + dt * speedVec[2]);
-			}
-			else
-			{
-				this->ParticlesTTL[i] = 0;
-			}
+			written[slot] = written[slot] || it->WrittenSlots[slot];
+			it->WrittenSlots[slot] = false;
 		}
-		if (this->ParticlesTTL[i] <= 0)
+	}
+	for (int slot = 0; slot < 2; slot++)
+	{
+		if (written[slot])
 		{
-			// Resample dead or out-of-bounds particle
-			this->InitParticle(i);
+			this->Positions[slot]->Modified();
+			if (this->Scalars[slot])
+			{
+				this->Scalars[slot]->Modified();
+			}
 		}
 	}
 }
 
 //----------------------------------------------------------------------------
-void vtkLIC3DMapper::Private::DrawParticles(vtkRenderer* ren, vtkActor* actor, bool animate)
+vtkIdType vtkLIC3DMapper::Private::GetNumberOfActiveParticles()
 {
-	if (!this->PrepareGLBuffers(ren, actor))
+	const vtkIdType nbParticles = static_cast<vtkIdType>(this->ParticlesTTL.size());
+	if (!this->Mapper->Interactive || this->Mapper->RemoteAdvection)
 	{
-		return;
+		return nbParticles;
 	}
+	// Particles are seeded randomly so the first ones are a random subset
+	const vtkIdType nbActive =
+		static_cast<vtkIdType>(nbParticles * this->Mapper->InteractiveParticleFraction);
+	return std::min(nbParticles, std::max<vtkIdType>(1, nbActive));
+}
 
-	vtkOpenGLCamera* cam = vtkOpenGLCamera::SafeDownCast(ren->GetActiveCamera());
-
-	this->ClearFlag = this->ClearFlag || this->Mapper->Alpha == 0. ||
-		this->ActorMTime < actor->GetMTime() || this->CameraMTime < cam->GetMTime();
-
-	if (this->ClearFlag && !animate)
+//----------------------------------------------------------------------------
+unsigned long vtkLIC3DMapper::Private::EstimateMemorySize(vtkIdType nbParticles)
+{
+	// Both slots of the rings, the time to live, block and update step
+	const vtkTypeUInt64 scalarSize = this->HasScalars && this->Scalars[0]
+		? 2 * this->Scalars[0]->GetNumberOfComponents() * this->Scalars[0]->GetDataTypeSize()
+		: 0;
+	vtkTypeUInt64 particleSize = 6 * sizeof(float) + sizeof(unsigned char) + sizeof(int) +
+		sizeof(int) + sizeof(vtkIdType) + scalarSize;
+	if (this->GetUpdatePeriod() > 1)
 	{
-		return;
+		particleSize += sizeof(float);
+	}
+	if (this->Mapper->SortInterval > 0)
+	{
+		// Keys and order, the buffers of the radix sort and the sorted copies
+		particleSize += 2 * (sizeof(unsigned int) + sizeof(vtkIdType)) + 6 * sizeof(float) +
+			sizeof(unsigned char) + sizeof(int) + sizeof(int) + sizeof(vtkIdType) + scalarSize;
 	}
 
-	vtkOpenGLRenderWindow* renWin = vtkOpenGLRenderWindow::SafeDownCast(ren->GetRenderWindow());
-
-	int nbParticles = static_cast<int>(this->ParticlesTTL.size());
-
-	vtkMatrix4x4* wcdc;
-	vtkMatrix4x4* wcvc;
-	vtkMatrix3x3* norms;
-	vtkMatrix4x4* vcdc;
-	cam->GetKeyMatrices(ren, wcvc, norms, vcdc, wcdc);
-	this->ActorMTime = actor->GetMTime();
-
-	////////////////////////////////////////////////
-	// Pass 1: Render segment to current buffer FBO
-	this->CurrentBuffer->SetContext(renWin);
-	this->CurrentBuffer->SaveCurrentBindingsAndBuffers();
-	this->CurrentBuffer->Bind();
-	this->CurrentBuffer->AddColorAttachment(
-		this->CurrentBuffer->GetBothMode(), 0, this->CurrentTexture);
-	this->CurrentBuffer->AddDepthAttachment(); // auto create depth buffer
-	this->CurrentBuffer->ActivateBuffer(0);
-	this->CurrentBuffer->Start(this->CurrentTexture->GetWidth(), this->CurrentTexture->GetHeight());
+	// Colors and quantized positions of the chunk slot uploaded at once
+	const vtkTypeUInt64 chunkSize =
+		(this->Mapper->QuantizePositions ? 4 + 3 * sizeof(unsigned short) : 4) *
+		static_cast<vtkTypeUInt64>(std::min(nbParticles, this->Mapper->DrawChunkSize));
+	return static_cast<unsigned long>(
+		(static_cast<vtkTypeUInt64>(nbParticles) * particleSize + chunkSize + 1023) / 1024);
+}
 
-	this->ShaderCache->ReadyShaderProgram(this->Program);
-	if (this->Program->IsUniformUsed("MCDCMatrix"))
+//----------------------------------------------------------------------------
+int vtkLIC3DMapper::Private::GetUpdatePeriod()
+{
+	if (this->Mapper->RemoteAdvection)
 	{
-		actor->ComputeMatrix();
-		if (!actor->GetIsIdentity())
-		{
-			vtkMatrix4x4* mcwc;
-			vtkMatrix3x3* anorms;
-			static_cast<vtkOpenGLActor*>(actor)->GetKeyMatrices(mcwc, anorms);
-			vtkMatrix4x4::Multiply4x4(mcwc, wcdc, this->TempMatrix4.Get());
-			this->Program->SetUniformMatrix("MCDCMatrix", this->TempMatrix4.Get());
-		}
-		else
-		{
-			this->Program->SetUniformMatrix("MCDCMatrix", wcdc);
-		}
+		return 1;
 	}
+	return std::max(1, static_cast<int>(std::floor(1. / this->Mapper->UpdateFraction + 0.5)));
+}
 
-	bool useScalars = this->Scalars && this->Mapper->GetScalarVisibility();
-	double* col = actor->GetProperty()->GetDiffuseColor();
-	float color[3];
-	color[0] = static_cast<double>(col[0]);
-	color[1] = static_cast<double>(col[1]);
-	color[2] = static_cast<double>(col[2]);
-	this->Program->SetUniform3f("color", color);
-	this->Program->SetUniformi("scalarVisibility", useScalars);
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::ComputeSegmentsFade(int period)
+{
+	// A segment is drawn at each of the period steps until the particle is
+	// advected again, with a weight decreasing with its age and summing to 1,
+	// so that it is accumulated in the trails like a fully advected particle.
+	const vtkIdType nbParticles = static_cast<vtkIdType>(this->ParticlesStep.size());
+	this->SegmentsFade->SetNumberOfTuples(nbParticles);
+	float* fade = this->SegmentsFade->GetPointer(0);
+	const float norm = 2.f / (period * (period + 1.f));
+	auto compute = [this, fade, period, norm](vtkIdType begin, vtkIdType end) {
+		for (vtkIdType i = begin; i < end; i++)
+		{
+			const vtkIdType age = this->Step - 1 - this->ParticlesStep[i];
+			fade[i] = age >= 0 && age < period ? norm * static_cast<float>(period - age) : 0.f;
+		}
+	};
+	vtkSMPTools::For(0, nbParticles, 4096, compute);
+	this->SegmentsFade->Modified();
+}
 
-	if (this->CreateWideLines && this->Program->IsUniformUsed("lineWidthNVC"))
+//----------------------------------------------------------------------------
+bool vtkLIC3DMapper::Private::UpdatePositionQuantization()
+{
+	// The positions are quantized like the streams, to 65534 steps, over the
+	// bounds of the data padded by the longest step of a particle: the end of
+	// a segment leaving the data lies outside of them, and clamping it would
+	// bend the segment. A step must stay well below the smallest cell edge for
+	// the segments to follow the flow. Decoded particles have no cells but are
+	// already quantized over the bounds, which loses nothing more.
+	bool quantize = this->Mapper->QuantizePositions && vtkMath::AreBoundsInitialized(this->Bounds);
+	const double pad = this->Mapper->RemoteAdvection
+		? 0.
+		: this->MaximumSpeed * this->Mapper->StepLength * this->GetUpdatePeriod();
+	double bounds[6];
+	double error = 0.;
+	for (int a = 0; quantize && a < 3; a++)
 	{
-		int vp[4];
-		glGetIntegerv(GL_VIEWPORT, vp);
-		float lineWidth[2];
-		lineWidth[0] = 2.0 * actor->GetProperty()->GetLineWidth() / vp[2];
-		lineWidth[1] = 2.0 * actor->GetProperty()->GetLineWidth() / vp[3];
-		this->Program->SetUniform2f("lineWidthNVC", lineWidth);
+		bounds[2 * a] = this->Bounds[2 * a] - pad;
+		bounds[2 * a + 1] = this->Bounds[2 * a + 1] + pad;
+		const double step = (bounds[2 * a + 1] - bounds[2 * a]) / 65534.;
+		quantize = this->MinimumCellSize == 0. || step <= 0.1 * this->MinimumCellSize;
+		error += 0.25 * step * step;
 	}
+	this->Mapper->PositionQuantizationError = quantize ? std::sqrt(error) : 0.;
 
-	// Setup the IBO
-	this->IndexBufferObject->Bind();
-	if (this->RebuildBufferObjects)
+	if (quantize != this->QuantizedUpload ||
+		(quantize && !std::equal(bounds, bounds + 6, this->QuantizationBounds)))
 	{
-		// We upload the indices only when number of particles changed
-		this->IndexBufferObject->Upload(
-			&this->Indices[0], nbParticles * 2, vtkOpenGLBufferObject::ElementArrayBuffer);
-		this->RebuildBufferObjects = false;
+		if (quantize)
+		{
+			std::copy(bounds, bounds + 6, this->QuantizationBounds);
+		}
+		this->QuantizedUpload = quantize;
+		this->QuantizationTime.Modified();
 	}
+	return quantize;
+}
 
-	vtkSmartPointer<vtkUnsignedCharArray> colors = 0;
-	if (useScalars)
+//----------------------------------------------------------------------------
+vtkLIC3DMapper::Private::Scratch& vtkLIC3DMapper::Private::GetScratch()
+{
+	Scratch& scratch = this->Scratches.Local();
+	if (!scratch.Cell)
 	{
-		colors.TakeReference(this->Mapper->GetLookupTable()->MapScalars(this->InterpolationScalarArray,
-			this->Mapper->GetColorMode(), this->Mapper->GetArrayComponent()));
+		scratch.Cell = vtkSmartPointer<vtkGenericCell>::New();
+		scratch.PointIds = vtkSmartPointer<vtkIdList>::New();
+		scratch.Random = vtkSmartPointer<vtkMinimalStandardRandomSequence>::New();
+		scratch.Weights.resize(VTK_CELL_SIZE);
+		scratch.WrittenSlots[0] = scratch.WrittenSlots[1] = false;
 	}
+	scratch.Tuple.resize(std::max<std::size_t>(1, this->ScalarTuple.size()));
+	return scratch;
+}
 
-	this->VBOs->ClearAllVBOs();
-	this->VBOs->ClearAllDataArrays();
-
-	// Create the VBOs
-	// Note: we provide dummy colors in case scalars are not visible
-	this->VBOs->AppendDataArray("vertexMC", this->Particles->GetData(), VTK_FLOAT);
-	this->VBOs->AppendDataArray(
-		"scalarColor", colors ? colors : this->Particles->GetData(), VTK_UNSIGNED_CHAR);
-	this->VBOs->BuildAllVBOs(ren);
-
-	// Setup the VAO
-	vtkNew<vtkOpenGLVertexArrayObject> vao;
-	vao->Bind();
-	this->VBOs->AddAllAttributesToVAO(this->Program, vao.Get());
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::UpdateParticles()
+{
+	const vtkIdType nbParticles = this->GetNumberOfActiveParticles();
+
+	// Only every period-th particle is advected, starting from a different
+	// one at each step. Strided rather than contiguous, the subset covers the
+	// whole domain once the particles are sorted by position.
+	const int period = this->GetUpdatePeriod();
+	const vtkIdType first = this->Step % period;
+	const vtkIdType nbUpdated =
+		nbParticles > first ? (nbParticles - first + period - 1) / period : 0;
+
+	// Particles are independent, each thread moves a range of them with its
+	// own cell, weights and random sequence
+	vtkTimerLog::MarkStartEvent("vtkLIC3DMapper::UpdateParticles");
+	if (this->Mapper->NUMAPlacement)
+	{
+		// One static range per thread in each of the two sorted runs of
+		// particles, the interactive ones and the others: a thread advects
+		// the particles of the same part of the domain at every step
+		const vtkIdType nbTotal = static_cast<vtkIdType>(this->ParticlesTTL.size());
+		const vtkIdType nbInteractive = std::min(nbParticles,
+			std::max<vtkIdType>(
+				1, static_cast<vtkIdType>(nbTotal * this->Mapper->InteractiveParticleFraction)));
+		const vtkIdType runs[3] = { 0, nbInteractive, nbParticles };
+		const int nbRanges = this->GetNumberOfPlacementRanges();
+		auto update = [this, &runs, nbRanges, period, first](vtkIdType begin, vtkIdType end) {
+			for (vtkIdType r = begin; r < end; r++)
+			{
+				for (int run = 0; run < 2; run++)
+				{
+					const vtkIdType runSize = runs[run + 1] - runs[run];
+					const vtkIdType rangeBegin = runs[run] + runSize * r / nbRanges;
+					const vtkIdType rangeEnd = runs[run] + runSize * (r + 1) / nbRanges;
+					// First particle of the range advected at this step
+					const vtkIdType offset = ((first - rangeBegin) % period + period) % period;
+					this->UpdateParticles(rangeBegin + offset, rangeEnd, period, this->GetScratch());
+				}
+			}
+		};
+		vtkSMPTools::For(0, nbRanges, 1, update);
+	}
+	else
+	{
+		auto update = [this, nbParticles, period, first](vtkIdType begin, vtkIdType end) {
+			this->UpdateParticles(first + begin * period, std::min(nbParticles, first + end * period),
+				period, this->GetScratch());
+		};
+		vtkSMPTools::For(0, nbUpdated, 256, update);
+	}
+	vtkTimerLog::MarkEndEvent("vtkLIC3DMapper::UpdateParticles");
 
-	// Perform rendering
-	glClearColor(0.0, 0.0, 0.0, 0.0);
-	glClear(GL_COLOR_BUFFER_BIT);
-	glDisable(GL_DEPTH_TEST);
-	if (!this->CreateWideLines)
+	if (this->IsDistributed())
 	{
-		glLineWidth(actor->GetProperty()->GetLineWidth());
+		// Gather the particles the threads freed and sent, in a deterministic
+		// order
+		for (vtkSMPThreadLocal<Scratch>::iterator it = this->Scratches.begin();
+			 it != this->Scratches.end(); ++it)
+		{
+			this->FreeSlots.insert(this->FreeSlots.end(), it->FreeSlots.begin(), it->FreeSlots.end());
+			this->SendBuffer.insert(
+				this->SendBuffer.end(), it->SendBuffer.begin(), it->SendBuffer.end());
+			it->FreeSlots.clear();
+			it->SendBuffer.clear();
+		}
+		std::sort(this->FreeSlots.begin(), this->FreeSlots.end());
+		this->ExchangeParticles();
 	}
-	glDrawArrays(GL_LINES, 0, nbParticles * 2);
-	vtkOpenGLCheckErrorMacro("Failed after rendering");
+	this->MarkWrittenSlots();
+	this->Step++;
 
-	this->IndexBufferObject->Release();
-	vao->Release();
+	if (this->Mapper->SortInterval > 0 && this->Step % this->Mapper->SortInterval == 0)
+	{
+		this->SortParticles();
+	}
+}
 
-	this->CurrentBuffer->UnBind();
-	this->CurrentBuffer->RestorePreviousBindingsAndBuffers();
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::SortParticles()
+{
+	const vtkIdType nbParticles = static_cast<vtkIdType>(this->ParticlesTTL.size());
+	if (nbParticles < 2)
+	{
+		return;
+	}
+
+	vtkTimerLog::MarkStartEvent("vtkLIC3DMapper::SortParticles");
+
+	// Morton code of the current particle positions, 10 bits per axis
+	float* points[2] = { static_cast<float*>(this->Positions[0]->GetVoidPointer(0)),
+		static_cast<float*>(this->Positions[1]->GetVoidPointer(0)) };
+	this->SortKeys.resize(nbParticles);
+	this->SortOrder.resize(nbParticles);
+	auto computeKeys = [this, &points](vtkIdType begin, vtkIdType end) {
+		for (vtkIdType i = begin; i < end; i++)
+		{
+			const float* pos = points[this->GetHead(i)] + 3 * i;
+			unsigned int code = 0;
+			for (int a = 0; a < 3; a++)
+			{
+				const double length = this->Bounds[2 * a + 1] - this->Bounds[2 * a];
+				const double t = length > 0. ? (pos[a] - this->Bounds[2 * a]) / length : 0.;
+				const unsigned int cell =
+					static_cast<unsigned int>(std::min(1023., std::max(0., t * 1024.)));
+				code |= ::SpreadBits(cell) << a;
+			}
+			this->SortKeys[i] = code;
+			this->SortOrder[i] = i;
+		}
+	};
+	vtkSMPTools::For(0, nbParticles, 1024, computeKeys);
+
+	// Interactive renders use the first particles, which must remain a random
+	// subset: they are sorted apart from the others
+	const vtkIdType nbInteractive = std::min(nbParticles,
+		std::max<vtkIdType>(
+			1, static_cast<vtkIdType>(nbParticles * this->Mapper->InteractiveParticleFraction)));
+	this->RadixSort.Sort(nbInteractive, &this->SortKeys[0], &this->SortOrder[0]);
+	this->RadixSort.Sort(nbParticles - nbInteractive, &this->SortKeys[0] + nbInteractive,
+		&this->SortOrder[0] + nbInteractive);
+
+	// Move both slots of the rings, the sorted scalars being swapped with the
+	// current ones so that both arrays are reused by the next sort
+	vtkDataArray* scalars[2] = { 0, 0 };
+	for (int slot = 0; slot < 2 && this->HasScalars; slot++)
+	{
+		vtkSmartPointer<vtkDataArray>& sorted = this->SortedScalars[slot];
+		if (!sorted || sorted->GetDataType() != this->Scalars[slot]->GetDataType() ||
+			sorted->GetNumberOfComponents() != this->Scalars[slot]->GetNumberOfComponents())
+		{
+			sorted.TakeReference(this->Scalars[slot]->NewInstance());
+			sorted->SetNumberOfComponents(this->Scalars[slot]->GetNumberOfComponents());
+		}
+		sorted->SetNumberOfTuples(nbParticles);
+		scalars[slot] = sorted;
+	}
+	this->SortedPoints.resize(6 * nbParticles);
+	this->SortedRing.resize(nbParticles);
+	this->SortedTTL.resize(nbParticles);
+	this->SortedBlocks.resize(nbParticles);
+	this->SortedSteps.resize(nbParticles);
+	auto permute = [this, &points, &scalars, nbParticles](vtkIdType begin, vtkIdType end) {
+		for (vtkIdType i = begin; i < end; i++)
+		{
+			const vtkIdType from = this->SortOrder[i];
+			for (int slot = 0; slot < 2; slot++)
+			{
+				std::copy(points[slot] + 3 * from, points[slot] + 3 * from + 3,
+					&this->SortedPoints[3 * (slot * nbParticles + i)]);
+				if (scalars[slot])
+				{
+					scalars[slot]->SetTuple(i, from, this->Scalars[slot]);
+				}
+			}
+			this->SortedRing[i] = this->ParticlesRing[from];
+			this->SortedTTL[i] = this->ParticlesTTL[from];
+			this->SortedBlocks[i] = this->ParticlesBlock[from];
+			this->SortedSteps[i] = this->ParticlesStep[from];
+		}
+	};
+	vtkSMPTools::For(0, nbParticles, 1024, permute);
+
+	for (int slot = 0; slot < 2; slot++)
+	{
+		std::copy(this->SortedPoints.begin() + 3 * slot * nbParticles,
+			this->SortedPoints.begin() + 3 * (slot + 1) * nbParticles, points[slot]);
+		this->Positions[slot]->Modified();
+		if (scalars[slot])
+		{
+			vtkSmartPointer<vtkDataArray> previous = this->Scalars[slot];
+			this->Scalars[slot] = scalars[slot];
+			this->Scalars[slot]->Modified();
+			this->SortedScalars[slot] = previous;
+		}
+	}
+	this->ParticlesRing.swap(this->SortedRing);
+	this->ParticlesTTL.swap(this->SortedTTL);
+	this->ParticlesBlock.swap(this->SortedBlocks);
+	this->ParticlesStep.swap(this->SortedSteps);
+	// Streams are delta encoded particle by particle, the next one must be a
+	// key frame
+	this->StreamPositions.clear();
+
+	vtkTimerLog::MarkEndEvent("vtkLIC3DMapper::SortParticles");
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::UpdateParticles(
+	vtkIdType begin, vtkIdType end, int stride, Scratch& scratch)
+{
+	const bool distributed = this->IsDistributed();
+
+	for (vtkIdType i = begin; i < end; i += stride)
+	{
+		// Catch up with the steps elapsed since the last update of the particle
+		const int elapsed = static_cast<int>(
+			std::max<vtkIdType>(1, std::min<vtkIdType>(stride, this->Step - this->ParticlesStep[i])));
+		const double dt = elapsed * this->Mapper->StepLength;
+		this->ParticlesStep[i] = this->Step;
+		this->ParticlesTTL[i] -= elapsed;
+		if (this->ParticlesTTL[i] > 0)
+		{
+			double pos[3];
+			const int head = this->GetHead(i);
+			this->Positions[head]->GetPoint(i, pos);
+
+			// Move the particle and fetch its color, written in the other slot of
+			// its ring, the current position becoming the previous one
+			double speedVec[3];
+			if (this->InterpolateSpeedAndColor(pos, speedVec, i, 1 - head, scratch))
+			{
+				const double newPos[3] = { pos[0] + dt * speedVec[0], pos[1] + dt * speedVec[1],
+					pos[2] + dt * speedVec[2] };
+				this->AdvanceRing(i, newPos, true, scratch);
+			}
+			else
+			{
+				// A particle which left the local data, ghost cells included,
+				// continues on the process owning its position
+				if (distributed && this->ParticlesBlock[i] < 0 && this->IsInRemoteBlock(pos, scratch))
+				{
+					this->SendParticle(i, pos, scratch);
+				}
+				this->ParticlesTTL[i] = 0;
+			}
+		}
+		if (this->ParticlesTTL[i] <= 0)
+		{
+			if (distributed)
+			{
+				// Filled with the particles received from the other processes first
+				scratch.FreeSlots.push_back(i);
+			}
+			else
+			{
+				// Resample dead or out-of-bounds particle
+				this->InitParticle(i, scratch);
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::DrawParticles(vtkRenderer* ren, vtkActor* actor, bool animate)
+{
+	if (!this->PrepareGLBuffers(ren, actor))
+	{
+		return;
+	}
+
+	vtkOpenGLCamera* cam = vtkOpenGLCamera::SafeDownCast(ren->GetActiveCamera());
+
+	const bool cameraChanged = this->CameraMTime < cam->GetMTime();
+	this->ClearFlag = this->ClearFlag || this->Mapper->Alpha == 0. ||
+		this->ActorMTime < actor->GetMTime();
+	// Only clears caused by new data, a resize or the actor are warmed up:
+	// the camera ones happen on every frame of an interaction
+	this->WarmUpPending = this->WarmUpPending || this->ClearFlag;
+
+	// Small camera moves keep the trail history by reprojecting it
+	const bool reproject = cameraChanged && !this->ClearFlag && this->Mapper->ReprojectTrails &&
+		this->HasTrailHistory && this->IsSmallCameraChange(cam);
+	this->ClearFlag = this->ClearFlag || (cameraChanged && !reproject);
+
+	if (this->ClearFlag && !animate)
+	{
+		return;
+	}
+
+	vtkOpenGLRenderWindow* renWin = vtkOpenGLRenderWindow::SafeDownCast(ren->GetRenderWindow());
+
+	vtkMatrix4x4* wcdc;
+	vtkMatrix4x4* wcvc;
+	vtkMatrix3x3* norms;
+	vtkMatrix4x4* vcdc;
+	cam->GetKeyMatrices(ren, wcvc, norms, vcdc, wcdc);
+	this->ActorMTime = actor->GetMTime();
 
-	static float s_quadTCoords[8] = { 0.f, 0.f, 1.f, 0.f, 1.f, 1.f, 0.f, 1.f };
-	static float s_quadVerts[12] = { -1.f, -1.f, 0.f, 1.f, -1.f, 0.f, 1.f, 1.f, 0.f, -1.f, 1.f, 0.f };
+	if (reproject)
+	{
+		this->ReprojectTrails(renWin, wcdc);
+		this->CameraMTime = cam->GetMTime();
+		this->SaveCameraState(cam, wcdc);
+	}
+
+	////////////////////////////////////////////////
+	// Pass 1: Render segment to current buffer FBO
+	this->DrawSegments(ren, actor, wcdc);
 
 	////////////////////////////////////////////////////////////////////
 	// Pass 2: Blend current and previous frame in the frame buffer FBO
 	if (animate)
+	{
+		const bool cleared = this->ClearFlag;
+		this->AccumulateSegments(renWin);
+		if (cleared)
+		{
+			this->CameraMTime = cam->GetMTime();
+			if (this->WarmUpPending && this->Mapper->WarmUp && !this->Mapper->Interactive &&
+				!this->IsDistributed())
+			{
+				this->WarmUpTrails(ren, actor, wcdc);
+			}
+			this->WarmUpPending = false;
+		}
+
+		// Remember the camera used to accumulate the trails
+		this->SaveCameraState(cam, wcdc);
+		this->HasTrailHistory = this->Mapper->ReprojectTrails;
+	}
+	////////////////////////////////////////////////
+	// Pass 3: Finally draw the FBO onto the screen. Distributed trails are
+	// drawn once composited with the ones of the other processes.
+	if (!this->ClearFlag && !this->IsDistributed())
+	{
+		this->PresentTrails(this->FrameTexture);
+	}
+	glEnable(GL_DEPTH_TEST);
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::PresentTrails(vtkTextureObject* trails)
+{
+	this->ShaderCache->ReadyShaderProgram(this->TextureProgram);
+	trails->Activate();
+	this->TextureProgram->SetUniformi("source", trails->GetTextureUnit());
+	// Setup blending equation
+	int prevBlendParams[4];
+	glGetIntegerv(GL_BLEND_SRC_RGB, &prevBlendParams[0]);
+	glGetIntegerv(GL_BLEND_DST_RGB, &prevBlendParams[1]);
+	glGetIntegerv(GL_BLEND_SRC_ALPHA, &prevBlendParams[2]);
+	glGetIntegerv(GL_BLEND_DST_ALPHA, &prevBlendParams[3]);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	this->RenderQuad(this->TextureProgram, this->TextureVAO);
+
+	// Restore blending equation state
+	glBlendFuncSeparate(
+		prevBlendParams[0], prevBlendParams[1], prevBlendParams[2], prevBlendParams[3]);
+
+	trails->Deactivate();
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::RenderQuad(
+	vtkShaderProgram* program, vtkOpenGLVertexArrayObject*& vao)
+{
+	// vtkOpenGLRenderUtilities::RenderQuad() creates its buffers at each call:
+	// the quad is uploaded once, and each program keeps its vertex array
+	static const float s_quad[20] = { -1.f, -1.f, 0.f, 0.f, 0.f, 1.f, -1.f, 0.f, 1.f, 0.f, -1.f,
+		1.f, 0.f, 0.f, 1.f, 1.f, 1.f, 0.f, 1.f, 1.f };
+	if (!this->QuadBuffer)
+	{
+		this->QuadBuffer = vtkOpenGLBufferObject::New();
+		this->QuadBuffer->SetType(vtkOpenGLBufferObject::ArrayBuffer);
+		this->QuadBuffer->Upload(s_quad, 20, vtkOpenGLBufferObject::ArrayBuffer);
+	}
+	if (!vao)
+	{
+		vao = vtkOpenGLVertexArrayObject::New();
+		vao->Bind();
+		vao->AddAttributeArray(
+			program, this->QuadBuffer, "vertexMC", 0, 5 * sizeof(float), VTK_FLOAT, 3, false);
+		vao->AddAttributeArray(program, this->QuadBuffer, "tcoordMC", 3 * sizeof(float),
+			5 * sizeof(float), VTK_FLOAT, 2, false);
+	}
+	else
+	{
+		vao->Bind();
+	}
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	vao->Release();
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::GetBufferSize(
+	vtkRenderer* ren, unsigned int& width, unsigned int& height)
+{
+	const int* size = ren->GetRenderWindow()->GetSize();
+	double scale = this->Mapper->Interactive ? this->Mapper->InteractiveResolutionFactor : 1.;
+	width = static_cast<unsigned int>(std::max(1., std::floor(size[0] * scale)));
+	height = static_cast<unsigned int>(std::max(1., std::floor(size[1] * scale)));
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::GetCompositeRegion(
+	int procId, int nbSwapProcs, vtkIdType nbPixels, vtkIdType& begin, vtkIdType& end)
+{
+	// Pixels a process ends up with after the binary swap, the lower half of
+	// the region being kept by the process of the pair with the bit unset
+	begin = 0;
+	end = procId < nbSwapProcs ? nbPixels : 0;
+	for (int bit = 1; bit < nbSwapProcs && end > 0; bit *= 2)
+	{
+		const vtkIdType middle = begin + (end - begin) / 2;
+		if (procId & bit)
+		{
+			begin = middle;
+		}
+		else
+		{
+			end = middle;
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::CompositeTrails(vtkRenderer* ren, bool hasData)
+{
+	vtkOpenGLRenderWindow* renWin = vtkOpenGLRenderWindow::SafeDownCast(ren->GetRenderWindow());
+	vtkMultiProcessController* controller = this->Mapper->Controller;
+	const int nbProcs = controller->GetNumberOfProcesses();
+	const int procId = controller->GetLocalProcessId();
+
+	// Render windows have the same size on all the processes
+	unsigned int width, height;
+	this->GetBufferSize(ren, width, height);
+	const vtkIdType nbPixels = static_cast<vtkIdType>(width) * height;
+
+	vtkTimerLog::MarkStartEvent("vtkLIC3DMapper::CompositeTrails");
+
+	// Premultiplied colors of the local trails, 8 bits are enough for the
+	// display. Processes without trails take part with a blank image.
+	this->CompositeImage.assign(4 * nbPixels, 0);
+	const bool hasTrails = hasData && !this->ClearFlag && this->FrameTexture &&
+		this->FrameTexture->GetWidth() == width && this->FrameTexture->GetHeight() == height;
+	if (hasTrails)
 	{
 		this->FrameBuffer->SetContext(renWin);
 		this->FrameBuffer->SaveCurrentBindingsAndBuffers();
 		this->FrameBuffer->Bind();
 		this->FrameBuffer->AddColorAttachment(this->FrameBuffer->GetBothMode(), 0, this->FrameTexture);
-		this->FrameBuffer->AddDepthAttachment(); // auto create depth buffer
-		this->FrameBuffer->ActivateBuffer(0);
-		this->FrameBuffer->Start(this->FrameTexture->GetWidth(), this->FrameTexture->GetHeight());
+		this->FrameBuffer->ActivateReadBuffer(0);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &this->CompositeImage[0]);
+		this->FrameBuffer->UnBind();
+		this->FrameBuffer->RestorePreviousBindingsAndBuffers();
+	}
+
+	// The processes above the largest power of two add their image to a
+	// lower one first
+	int nbSwapProcs = 1;
+	while (nbSwapProcs * 2 <= nbProcs)
+	{
+		nbSwapProcs *= 2;
+	}
+	unsigned char* image = &this->CompositeImage[0];
+	this->CompositePiece.resize(4 * nbPixels);
+	unsigned char* piece = &this->CompositePiece[0];
+	if (procId >= nbSwapProcs)
+	{
+		controller->Send(image, 4 * nbPixels, procId - nbSwapProcs, vtkLICCompositeTag);
+	}
+	else if (procId + nbSwapProcs < nbProcs)
+	{
+		controller->Receive(piece, 4 * nbPixels, procId + nbSwapProcs, vtkLICCompositeTag);
+		::AddPremultiplied(image, piece, 4 * nbPixels);
+	}
+
+	// Binary swap: at each round, a pair of processes splits its region in
+	// two, each one sending the half it gives up to the other
+	vtkIdType begin = 0;
+	vtkIdType end = nbPixels;
+	for (int bit = 1; bit < nbSwapProcs && procId < nbSwapProcs; bit *= 2)
+	{
+		const int partner = procId ^ bit;
+		const vtkIdType middle = begin + (end - begin) / 2;
+		const vtkIdType keepBegin = (procId & bit) ? middle : begin;
+		const vtkIdType keepEnd = (procId & bit) ? end : middle;
+		const vtkIdType sendBegin = (procId & bit) ? begin : middle;
+		const vtkIdType sendEnd = (procId & bit) ? middle : end;
+		// The lower process sends first so that the blocking calls pair up
+		unsigned char* sent = image + 4 * sendBegin;
+		const vtkIdType sentLength = 4 * (sendEnd - sendBegin);
+		const vtkIdType keptLength = 4 * (keepEnd - keepBegin);
+		if (procId < partner)
+		{
+			controller->Send(sent, sentLength, partner, vtkLICCompositeTag);
+			controller->Receive(piece, keptLength, partner, vtkLICCompositeTag);
+		}
+		else
+		{
+			controller->Receive(piece, keptLength, partner, vtkLICCompositeTag);
+			controller->Send(sent, sentLength, partner, vtkLICCompositeTag);
+		}
+		::AddPremultiplied(image + 4 * keepBegin, piece, keptLength);
+		begin = keepBegin;
+		end = keepEnd;
+	}
+
+	// Every process gets the whole image: ParaView composites the render
+	// windows by depth, and the trails do not write any, so it may keep the
+	// pixels of any process
+	this->CompositeLengths.resize(nbProcs);
+	this->CompositeOffsets.resize(nbProcs);
+	for (int p = 0; p < nbProcs; p++)
+	{
+		vtkIdType pBegin, pEnd;
+		this->GetCompositeRegion(p, nbSwapProcs, nbPixels, pBegin, pEnd);
+		this->CompositeOffsets[p] = 4 * pBegin;
+		this->CompositeLengths[p] = 4 * (pEnd - pBegin);
+	}
+	std::copy(image + 4 * begin, image + 4 * end, piece);
+	controller->AllGatherV(piece, image, this->CompositeLengths[procId],
+		&this->CompositeLengths[0], &this->CompositeOffsets[0]);
+
+	vtkTimerLog::MarkEndEvent("vtkLIC3DMapper::CompositeTrails");
+
+	if (!this->CompositeTexture)
+	{
+		this->CompositeTexture = vtkTextureObject::New();
+		this->CompositeTexture->SetContext(renWin);
+		this->CompositeTexture->SetMagnificationFilter(vtkTextureObject::Linear);
+	}
+	this->CompositeTexture->Create2DFromRaw(width, height, 4, VTK_UNSIGNED_CHAR, image);
+
+	if (!this->ShaderCache)
+	{
+		this->ShaderCache = renWin->GetShaderCache();
+	}
+	if (!this->TextureProgram)
+	{
+		this->TextureProgram =
+			this->ShaderCache->ReadyShaderProgram(vtkTextureObjectVS, vtkStreamLinesCopy_fs, "");
+		this->TextureProgram->Register(this);
+	}
+	this->HasCompositeTrails = true;
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::PresentCompositeTrails()
+{
+	if (this->HasCompositeTrails)
+	{
+		this->PresentTrails(this->CompositeTexture);
+		glEnable(GL_DEPTH_TEST);
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::DrawSegments(
+	vtkRenderer* ren, vtkActor* actor, vtkMatrix4x4* wcdc)
+{
+	vtkOpenGLRenderWindow* renWin = vtkOpenGLRenderWindow::SafeDownCast(ren->GetRenderWindow());
+	const bool useDepth = this->Mapper->ReprojectTrails;
+
+	this->CurrentBuffer->SetContext(renWin);
+	this->CurrentBuffer->SaveCurrentBindingsAndBuffers();
+	this->CurrentBuffer->Bind();
+	this->CurrentBuffer->AddColorAttachment(
+		this->CurrentBuffer->GetBothMode(), 0, this->CurrentTexture);
+	this->CurrentBuffer->AddDepthAttachment(); // auto create depth buffer
+	if (useDepth)
+	{
+		this->CurrentBuffer->AddColorAttachment(
+			this->CurrentBuffer->GetBothMode(), 1, this->CurrentDepthTexture);
+		this->CurrentBuffer->ActivateDrawBuffers(2);
+	}
+	else
+	{
+		this->CurrentBuffer->ActivateBuffer(0);
+	}
+	this->CurrentBuffer->Start(this->CurrentTexture->GetWidth(), this->CurrentTexture->GetHeight());
+
+	this->ShaderCache->ReadyShaderProgram(this->Program);
+	if (this->Program->IsUniformUsed("MCDCMatrix"))
+	{
+		actor->ComputeMatrix();
+		if (!actor->GetIsIdentity())
+		{
+			vtkMatrix4x4* mcwc;
+			vtkMatrix3x3* anorms;
+			static_cast<vtkOpenGLActor*>(actor)->GetKeyMatrices(mcwc, anorms);
+			vtkMatrix4x4::Multiply4x4(mcwc, wcdc, this->TempMatrix4.Get());
+			this->Program->SetUniformMatrix("MCDCMatrix", this->TempMatrix4.Get());
+		}
+		else
+		{
+			this->Program->SetUniformMatrix("MCDCMatrix", wcdc);
+		}
+	}
+
+	bool useScalars = this->HasScalars && this->Mapper->GetScalarVisibility();
+	double* col = actor->GetProperty()->GetDiffuseColor();
+	float color[3];
+	color[0] = static_cast<double>(col[0]);
+	color[1] = static_cast<double>(col[1]);
+	color[2] = static_cast<double>(col[2]);
+	this->Program->SetUniform3f("color", color);
+	this->Program->SetUniformi("scalarVisibility", useScalars);
+	const int period = this->GetUpdatePeriod();
+	this->Program->SetUniformi("fadeSegments", period > 1);
+
+	if (this->CreateWideLines && this->Program->IsUniformUsed("lineWidthNVC"))
+	{
+		int vp[4];
+		glGetIntegerv(GL_VIEWPORT, vp);
+		float lineWidth[2];
+		lineWidth[0] = 2.0 * actor->GetProperty()->GetLineWidth() / vp[2];
+		lineWidth[1] = 2.0 * actor->GetProperty()->GetLineWidth() / vp[3];
+		this->Program->SetUniform2f("lineWidthNVC", lineWidth);
+	}
+
+	if (period > 1)
+	{
+		this->ComputeSegmentsFade(period);
+	}
+
+	// Quantized positions are normalized to [0, 1] when read, the dequantized
+	// position being origin + v * scale
+	const bool quantize = this->UpdatePositionQuantization();
+	this->Program->SetUniformi("quantizedPositions", quantize);
+	if (quantize)
+	{
+		float origin[3];
+		float scale[3];
+		for (int a = 0; a < 3; a++)
+		{
+			origin[a] = static_cast<float>(this->QuantizationBounds[2 * a]);
+			scale[a] = static_cast<float>((this->QuantizationBounds[2 * a + 1] -
+				this->QuantizationBounds[2 * a]) * 65535. / 65534.);
+		}
+		this->Program->SetUniform3f("quantizationOrigin", origin);
+		this->Program->SetUniform3f("quantizationScale", scale);
+	}
+
+	// Perform rendering
+	glClearColor(0.0, 0.0, 0.0, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDisable(GL_DEPTH_TEST);
+	if (!this->CreateWideLines)
+	{
+		glLineWidth(actor->GetProperty()->GetLineWidth());
+	}
+
+	// The segments are drawn by chunks of DrawChunkSize particles, so that
+	// the buffers keep a bounded size and a draw never exceeds the vertex
+	// counts of the GL whatever the number of particles. Each chunk keeps both
+	// slots of the rings of its particles, a slot being uploaded again only
+	// once written, and each particle is an instance of a line whose ends are
+	// picked from its ring by the vertex shader.
+	const vtkIdType nbParticles = static_cast<vtkIdType>(this->ParticlesRing.size());
+	const vtkIdType nbActive = this->GetNumberOfActiveParticles();
+	const vtkIdType chunkSize = this->Mapper->DrawChunkSize;
+	const std::size_t nbChunks = static_cast<std::size_t>((nbParticles + chunkSize - 1) / chunkSize);
+	if (this->DrawChunks.size() != nbChunks ||
+		(nbChunks > 0 && this->DrawChunks[0].Count != std::min(chunkSize, nbParticles)) ||
+		(nbChunks > 0 &&
+			this->DrawChunks.back().First + this->DrawChunks.back().Count != nbParticles))
+	{
+		this->ReleaseDrawChunks();
+		this->DrawChunks.resize(nbChunks);
+		for (std::size_t c = 0; c < nbChunks; c++)
+		{
+			DrawChunk& chunk = this->DrawChunks[c];
+			chunk.First = static_cast<vtkIdType>(c) * chunkSize;
+			chunk.Count = std::min(chunkSize, nbParticles - chunk.First);
+			for (int slot = 0; slot < 2; slot++)
+			{
+				chunk.Positions[slot] = vtkOpenGLBufferObject::New();
+				chunk.Positions[slot]->SetType(vtkOpenGLBufferObject::ArrayBuffer);
+				chunk.Colors[slot] = vtkOpenGLBufferObject::New();
+				chunk.Colors[slot]->SetType(vtkOpenGLBufferObject::ArrayBuffer);
+				chunk.HasColors[slot] = false;
+			}
+			chunk.Ring = vtkOpenGLBufferObject::New();
+			chunk.Ring->SetType(vtkOpenGLBufferObject::ArrayBuffer);
+			chunk.Fade = vtkOpenGLBufferObject::New();
+			chunk.Fade->SetType(vtkOpenGLBufferObject::ArrayBuffer);
+		}
+	}
+
+	vtkScalarsToColors* lut = this->Mapper->GetLookupTable();
+
+	if (!this->SegmentsVAO)
+	{
+		this->SegmentsVAO = vtkOpenGLVertexArrayObject::New();
+	}
+	vtkOpenGLVertexArrayObject* vao = this->SegmentsVAO;
+	vao->Bind();
+	for (std::size_t c = 0; c < nbChunks && this->DrawChunks[c].First < nbActive; c++)
+	{
+		DrawChunk& chunk = this->DrawChunks[c];
+		for (int slot = 0; slot < 2; slot++)
+		{
+			vtkMTimeType slotTime =
+				std::max(this->Positions[slot]->GetMTime(), this->QuantizationTime.GetMTime());
+			if (useScalars)
+			{
+				slotTime = std::max(slotTime, std::max(this->Scalars[slot]->GetMTime(),
+												std::max(lut->GetMTime(), this->Mapper->GetMTime())));
+			}
+			if (chunk.UploadTime[slot].GetMTime() >= slotTime && (!useScalars || chunk.HasColors[slot]))
+			{
+				continue;
+			}
+			const float* points =
+				static_cast<float*>(this->Positions[slot]->GetVoidPointer(0)) + 3 * chunk.First;
+			if (quantize)
+			{
+				this->QuantizedPoints.resize(3 * chunk.Count);
+				unsigned short* quantized = &this->QuantizedPoints[0];
+				const double* bounds = this->QuantizationBounds;
+				auto quantizeChunk = [points, quantized, bounds](vtkIdType begin, vtkIdType end) {
+					for (vtkIdType i = 3 * begin; i < 3 * end; i++)
+					{
+						const int a = static_cast<int>(i % 3);
+						quantized[i] = ::Quantize(points[i], bounds[2 * a], bounds[2 * a + 1]);
+					}
+				};
+				vtkSMPTools::For(0, chunk.Count, 4096, quantizeChunk);
+				chunk.Positions[slot]->Upload(
+					quantized, 3 * chunk.Count, vtkOpenGLBufferObject::ArrayBuffer);
+			}
+			else
+			{
+				chunk.Positions[slot]->Upload(
+					points, 3 * chunk.Count, vtkOpenGLBufferObject::ArrayBuffer);
+			}
+			chunk.HasColors[slot] = useScalars;
+			if (useScalars)
+			{
+				this->MapChunkColors(lut, slot, chunk.First, chunk.Count);
+				chunk.Colors[slot]->Upload(this->ChunkColors->GetPointer(0), 4 * chunk.Count,
+					vtkOpenGLBufferObject::ArrayBuffer);
+			}
+			chunk.UploadTime[slot].Modified();
+		}
+
+		// The ring and fade of the particles change at every step
+		chunk.Ring->Upload(&this->ParticlesRing[chunk.First], chunk.Count,
+			vtkOpenGLBufferObject::ArrayBuffer);
+		if (period > 1)
+		{
+			chunk.Fade->Upload(this->SegmentsFade->GetPointer(chunk.First), chunk.Count,
+				vtkOpenGLBufferObject::ArrayBuffer);
+		}
+
+		// One instance per particle
+		const char* positionNames[2] = { "vertexMC0", "vertexMC1" };
+		const char* colorNames[2] = { "scalarColor0", "scalarColor1" };
+		for (int slot = 0; slot < 2; slot++)
+		{
+			if (quantize)
+			{
+				vao->AddAttributeArrayWithDivisor(this->Program, chunk.Positions[slot],
+					positionNames[slot], 0, 3 * sizeof(unsigned short), VTK_UNSIGNED_SHORT, 3, true, 1,
+					false);
+			}
+			else
+			{
+				vao->AddAttributeArrayWithDivisor(this->Program, chunk.Positions[slot],
+					positionNames[slot], 0, 3 * sizeof(float), VTK_FLOAT, 3, false, 1, false);
+			}
+			if (useScalars)
+			{
+				vao->AddAttributeArrayWithDivisor(this->Program, chunk.Colors[slot], colorNames[slot],
+					0, 4 * sizeof(unsigned char), VTK_UNSIGNED_CHAR, 4, true, 1, false);
+			}
+		}
+		vao->AddAttributeArrayWithDivisor(this->Program, chunk.Ring, "ring", 0,
+			sizeof(unsigned char), VTK_UNSIGNED_CHAR, 1, false, 1, false);
+		if (period > 1)
+		{
+			vao->AddAttributeArrayWithDivisor(this->Program, chunk.Fade, "segmentFade", 0,
+				sizeof(float), VTK_FLOAT, 1, false, 1, false);
+		}
+
+		glDrawArraysInstanced(
+			GL_LINES, 0, 2, static_cast<GLsizei>(std::min(chunk.Count, nbActive - chunk.First)));
+		vtkOpenGLCheckErrorMacro("Failed after rendering");
+	}
+	vao->Release();
+
+	this->CurrentBuffer->UnBind();
+	this->CurrentBuffer->RestorePreviousBindingsAndBuffers();
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::MapChunkColors(
+	vtkScalarsToColors* lut, int slot, vtkIdType first, vtkIdType count)
+{
+	// Same mapping as vtkScalarsToColors::MapScalars(), written to ChunkColors
+	// rather than to a new array
+	vtkDataArray* scalars = this->Scalars[slot];
+	const int nbComp = scalars->GetNumberOfComponents();
+	const int colorMode = this->Mapper->GetColorMode();
+	// Only grown: data arrays reallocate when shrunk, and the last chunk is
+	// usually smaller than the others
+	if (this->ChunkColors->GetNumberOfTuples() < count)
+	{
+		this->ChunkColors->SetNumberOfTuples(count);
+	}
+	if (colorMode == VTK_COLOR_MODE_DIRECT_SCALARS ||
+		(colorMode == VTK_COLOR_MODE_DEFAULT && scalars->GetDataType() == VTK_UNSIGNED_CHAR))
+	{
+		const double scale =
+			scalars->GetDataType() == VTK_FLOAT || scalars->GetDataType() == VTK_DOUBLE ? 255. : 1.;
+		const double alpha = std::min(std::max(lut->GetAlpha(), 0.), 1.);
+		switch (scalars->GetDataType())
+		{
+			vtkTemplateMacro(::DirectColorsToRGBA(
+				static_cast<VTK_TT*>(scalars->GetVoidPointer(first * nbComp)),
+				this->ChunkColors->GetPointer(0), count, nbComp, scale, alpha));
+		}
+		return;
+	}
+
+	int component = this->Mapper->GetArrayComponent();
+	if (component < 0 && nbComp > 1)
+	{
+		lut->MapVectorsThroughTable(scalars->GetVoidPointer(first * nbComp),
+			this->ChunkColors->GetPointer(0), scalars->GetDataType(), count, nbComp, VTK_RGBA);
+	}
+	else
+	{
+		component = std::min(std::max(component, 0), nbComp - 1);
+		lut->MapScalarsThroughTable2(scalars->GetVoidPointer(first * nbComp + component),
+			this->ChunkColors->GetPointer(0), scalars->GetDataType(), count, nbComp, VTK_RGBA);
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::ReleaseDrawChunks()
+{
+	for (std::size_t c = 0; c < this->DrawChunks.size(); c++)
+	{
+		for (int slot = 0; slot < 2; slot++)
+		{
+			RELEASE_VTKGL_OBJECT2(this->DrawChunks[c].Positions[slot]);
+			RELEASE_VTKGL_OBJECT2(this->DrawChunks[c].Colors[slot]);
+		}
+		RELEASE_VTKGL_OBJECT2(this->DrawChunks[c].Ring);
+		RELEASE_VTKGL_OBJECT2(this->DrawChunks[c].Fade);
+	}
+	this->DrawChunks.clear();
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::AccumulateSegments(vtkOpenGLRenderWindow* renWin)
+{
+	const bool useDepth = this->Mapper->ReprojectTrails;
+
+	this->FrameBuffer->SetContext(renWin);
+	this->FrameBuffer->SaveCurrentBindingsAndBuffers();
+	this->FrameBuffer->Bind();
+	this->FrameBuffer->AddColorAttachment(this->FrameBuffer->GetBothMode(), 0, this->FrameTexture);
+	this->FrameBuffer->AddDepthAttachment(); // auto create depth buffer
+	if (useDepth)
+	{
+		this->FrameBuffer->AddColorAttachment(
+			this->FrameBuffer->GetBothMode(), 1, this->FrameDepthTexture);
+		this->FrameBuffer->ActivateDrawBuffers(2);
+	}
+	else
+	{
+		this->FrameBuffer->ActivateBuffer(0);
+	}
+	this->FrameBuffer->Start(this->FrameTexture->GetWidth(), this->FrameTexture->GetHeight());
+
+	if (this->ClearFlag)
+	{
+		// Clear frame buffer if camera changed
+		glClear(GL_COLOR_BUFFER_BIT);
+		this->ClearFlag = false;
+	}
+
+	this->ShaderCache->ReadyShaderProgram(this->BlendingProgram);
+	this->FrameTexture->Activate();
+	this->CurrentTexture->Activate();
+	double alpha =
+		1.0 - (1.0 / (this->Mapper->MaxTimeToLive * std::max(0.00001, this->Mapper->Alpha)));
+	this->BlendingProgram->SetUniformf("alpha", alpha);
+	this->BlendingProgram->SetUniformi("prev", this->FrameTexture->GetTextureUnit());
+	this->BlendingProgram->SetUniformi("current", this->CurrentTexture->GetTextureUnit());
+	if (useDepth)
+	{
+		this->FrameDepthTexture->Activate();
+		this->CurrentDepthTexture->Activate();
+		this->BlendingProgram->SetUniformi("prevDepth", this->FrameDepthTexture->GetTextureUnit());
+		this->BlendingProgram->SetUniformi(
+			"currentDepth", this->CurrentDepthTexture->GetTextureUnit());
+	}
+	this->RenderQuad(this->BlendingProgram, this->BlendingVAO);
+	if (useDepth)
+	{
+		this->CurrentDepthTexture->Deactivate();
+		this->FrameDepthTexture->Deactivate();
+	}
+	this->CurrentTexture->Deactivate();
+
+	this->FrameBuffer->UnBind();
+	this->FrameBuffer->RestorePreviousBindingsAndBuffers();
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::WarmUpTrails(
+	vtkRenderer* ren, vtkActor* actor, vtkMatrix4x4* wcdc)
+{
+	// The blending reaches its steady state after about MaxTimeToLive * Alpha
+	// frames: run them right away so the first presented frame already shows
+	// full trails. Each step goes through the regular passes so the decay
+	// weights are the same as during the animation.
+	vtkOpenGLRenderWindow* renWin = vtkOpenGLRenderWindow::SafeDownCast(ren->GetRenderWindow());
+	const int nbSteps =
+		static_cast<int>(std::ceil(this->Mapper->MaxTimeToLive * this->Mapper->Alpha));
+	const double endTime = vtkTimerLog::GetUniversalTime() + this->Mapper->WarmUpTimeBudget;
+
+	vtkTimerLog::MarkStartEvent("vtkLIC3DMapper::WarmUp");
+	for (int i = 1; i < nbSteps && vtkTimerLog::GetUniversalTime() < endTime; i++)
+	{
+		this->UpdateParticles();
+		this->DrawSegments(ren, actor, wcdc);
+		this->AccumulateSegments(renWin);
+	}
+	vtkTimerLog::MarkEndEvent("vtkLIC3DMapper::WarmUp");
+}
+
+//----------------------------------------------------------------------------
+bool vtkLIC3DMapper::Private::PrepareGLBuffers(vtkRenderer* ren, vtkActor* actor)
+{
+	if (!this->CurrentBuffer)
+	{
+		this->CurrentBuffer = vtkOpenGLFramebufferObject::New();
+	}
+	if (!this->FrameBuffer)
+	{
+		this->FrameBuffer = vtkOpenGLFramebufferObject::New();
+	}
+	if (!this->ReprojectBuffer && this->Mapper->ReprojectTrails)
+	{
+		this->ReprojectBuffer = vtkOpenGLFramebufferObject::New();
+	}
+
+	vtkOpenGLRenderWindow* renWin = vtkOpenGLRenderWindow::SafeDownCast(ren->GetRenderWindow());
+	unsigned int width, height;
+	this->GetBufferSize(ren, width, height);
+
+	if (!this->CurrentTexture)
+	{
+		this->CurrentTexture = vtkTextureObject::New();
+		this->CurrentTexture->SetContext(renWin);
+	}
+
+	if (this->CurrentTexture->GetWidth() != width || this->CurrentTexture->GetHeight() != height)
+	{
+		this->CurrentTexture->Create2D(width, height, 4, VTK_FLOAT, false);
+		this->ClearFlag = true;
+	}
+
+	if (!this->FrameTexture)
+	{
+		this->FrameTexture = vtkTextureObject::New();
+		this->FrameTexture->SetContext(renWin);
+		// Reduced resolution buffers get stretched onto the screen
+		this->FrameTexture->SetMagnificationFilter(vtkTextureObject::Linear);
+	}
+
+	if (this->FrameTexture->GetWidth() != width || this->FrameTexture->GetHeight() != height)
+	{
+		this->FrameTexture->Create2D(width, height, 4, VTK_FLOAT, false);
+		this->ClearFlag = true;
+	}
+
+	if (this->Mapper->ReprojectTrails)
+	{
+		// Depth of the trails and ping-pong targets used for the reprojection
+		vtkTextureObject** textures[4] = { &this->CurrentDepthTexture, &this->FrameDepthTexture,
+			&this->ReprojectTexture, &this->ReprojectDepthTexture };
+		for (int i = 0; i < 4; i++)
+		{
+			vtkTextureObject*& tex = *textures[i];
+			if (!tex)
+			{
+				tex = vtkTextureObject::New();
+				tex->SetContext(renWin);
+				tex->SetMagnificationFilter(vtkTextureObject::Linear);
+			}
+			if (tex->GetWidth() != width || tex->GetHeight() != height)
+			{
+				tex->Create2D(width, height, tex == this->ReprojectTexture ? 4 : 1, VTK_FLOAT, false);
+				this->ClearFlag = true;
+			}
+		}
+	}
+
+	if (!this->ShaderCache)
+	{
+		this->ShaderCache = renWin->GetShaderCache();
+	}
+
+	bool prevCreateWideLines = this->CreateWideLines;
+	this->CreateWideLines = actor->GetProperty()->GetLineWidth() > 1.0 &&
+		vtkOpenGLRenderWindow::GetContextSupportsOpenGL32() &&
+		actor->GetProperty()->GetLineWidth() > renWin->GetMaximumHardwareLineWidth();
+
+	if (!this->Program || (prevCreateWideLines != this->CreateWideLines))
+	{
+		this->ShaderCache->ReleaseCurrentShader();
+		if (this->Program)
+		{
+			RELEASE_VTKGL_OBJECT(this->Program);
+		}
+		this->Program = this->ShaderCache->ReadyShaderProgram(
+			vtkStreamLines_vs, vtkStreamLines_fs, this->CreateWideLines ? vtkStreamLines_gs : "");
+		this->Program->Register(this);
+	}
+
+	if (!this->BlendingProgram)
+	{
+		this->BlendingProgram =
+			this->ShaderCache->ReadyShaderProgram(vtkTextureObjectVS, vtkStreamLinesBlending_fs, "");
+		this->BlendingProgram->Register(this);
+	}
+
+	if (!this->TextureProgram)
+	{
+		this->TextureProgram =
+			this->ShaderCache->ReadyShaderProgram(vtkTextureObjectVS, vtkStreamLinesCopy_fs, "");
+		this->TextureProgram->Register(this);
+	}
+
+	if (!this->ReprojectProgram && this->Mapper->ReprojectTrails)
+	{
+		this->ReprojectProgram = this->ShaderCache->ReadyShaderProgram(
+			vtkStreamLinesReproject_vs, vtkStreamLinesReproject_fs, "");
+		this->ReprojectProgram->Register(this);
+	}
+
+	return this->CurrentTexture && this->FrameTexture && this->ShaderCache && this->Program &&
+		this->BlendingProgram && this->TextureProgram &&
+		(!this->Mapper->ReprojectTrails || this->ReprojectProgram);
+}
+
+//----------------------------------------------------------------------------
+bool vtkLIC3DMapper::Private::IsSmallCameraChange(vtkCamera* cam)
+{
+	double pos[3], fp[3], dir[3], lastDir[3];
+	cam->GetPosition(pos);
+	cam->GetFocalPoint(fp);
+	vtkMath::Subtract(fp, pos, dir);
+	vtkMath::Subtract(this->LastCameraFocalPoint, this->LastCameraPosition, lastDir);
+	double dist = vtkMath::Normalize(dir);
+	double lastDist = vtkMath::Normalize(lastDir);
+	if (dist == 0. || lastDist == 0. || cam->GetViewAngle() != this->LastViewAngle)
+	{
+		return false;
+	}
+
+	// Rotation of the view direction
+	double cosAngle = std::max(-1., std::min(1., vtkMath::Dot(dir, lastDir)));
+	double maxAngle = vtkMath::RadiansFromDegrees(this->Mapper->MaximumReprojectionAngle);
+	if (std::acos(cosAngle) > maxAngle)
+	{
+		return false;
+	}
+
+	// Panning, relative to the distance to the focal point
+	double pan = std::sqrt(vtkMath::Distance2BetweenPoints(fp, this->LastCameraFocalPoint));
+	if (pan > lastDist * std::tan(maxAngle))
+	{
+		return false;
+	}
+
+	// Zooming
+	const double maxZoom = 1.5;
+	double zoom = cam->GetParallelProjection() && this->LastParallelScale > 0.
+		? cam->GetParallelScale() / this->LastParallelScale
+		: dist / lastDist;
+	return zoom < maxZoom && zoom > 1. / maxZoom;
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::SaveCameraState(vtkCamera* cam, vtkMatrix4x4* wcdc)
+{
+	cam->GetPosition(this->LastCameraPosition);
+	cam->GetFocalPoint(this->LastCameraFocalPoint);
+	this->LastViewAngle = cam->GetViewAngle();
+	this->LastParallelScale = cam->GetParallelScale();
+	this->LastWCDC->DeepCopy(wcdc);
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::ReprojectTrails(vtkOpenGLRenderWindow* renWin, vtkMatrix4x4* wcdc)
+{
+	// Previous normalized device coordinates to new clip coordinates. Like
+	// other key matrices, these are stored transposed.
+	vtkMatrix4x4::Invert(this->LastWCDC.Get(), this->TempMatrix4.Get());
+	vtkMatrix4x4::Multiply4x4(this->TempMatrix4.Get(), wcdc, this->ReprojectionMatrix.Get());
+
+	unsigned int width = this->FrameTexture->GetWidth();
+	unsigned int height = this->FrameTexture->GetHeight();
+
+	this->ReprojectBuffer->SetContext(renWin);
+	this->ReprojectBuffer->SaveCurrentBindingsAndBuffers();
+	this->ReprojectBuffer->Bind();
+	this->ReprojectBuffer->AddColorAttachment(
+		this->ReprojectBuffer->GetBothMode(), 0, this->ReprojectTexture);
+	this->ReprojectBuffer->AddColorAttachment(
+		this->ReprojectBuffer->GetBothMode(), 1, this->ReprojectDepthTexture);
+	this->ReprojectBuffer->AddDepthAttachment(); // auto create depth buffer
+	this->ReprojectBuffer->ActivateDrawBuffers(2);
+	this->ReprojectBuffer->Start(width, height);
+
+	glClearColor(0.0, 0.0, 0.0, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+
+	// Splat every texel of the accumulated trails at its new location
+	this->ShaderCache->ReadyShaderProgram(this->ReprojectProgram);
+	if (!this->ReprojectVAO)
+	{
+		this->ReprojectVAO = vtkOpenGLVertexArrayObject::New();
+	}
+	this->ReprojectVAO->Bind();
+	this->FrameTexture->Activate();
+	this->FrameDepthTexture->Activate();
+	this->ReprojectProgram->SetUniformi("prevColor", this->FrameTexture->GetTextureUnit());
+	this->ReprojectProgram->SetUniformi("prevDepth", this->FrameDepthTexture->GetTextureUnit());
+	this->ReprojectProgram->SetUniformMatrix("reprojectionMatrix", this->ReprojectionMatrix.Get());
+	glPointSize(2.0);
+	glDrawArrays(GL_POINTS, 0, width * height);
+	glPointSize(1.0);
+	vtkOpenGLCheckErrorMacro("Failed after reprojecting trails");
+	this->FrameDepthTexture->Deactivate();
+	this->FrameTexture->Deactivate();
+	this->ReprojectVAO->Release();
+
+	this->ReprojectBuffer->UnBind();
+	this->ReprojectBuffer->RestorePreviousBindingsAndBuffers();
+
+	// The reprojected trails become the accumulated ones
+	std::swap(this->FrameTexture, this->ReprojectTexture);
+	std::swap(this->FrameDepthTexture, this->ReprojectDepthTexture);
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::AddBlock(vtkDataSet* dataSet, int level, std::vector<Block>& blocks)
+{
+	if (!dataSet || dataSet->GetNumberOfCells() == 0 || level > this->Mapper->MaximumAMRLevel)
+	{
+		return;
+	}
+
+	int association;
+	vtkDataArray* vectors = this->Mapper->GetInputArrayToProcess(1, dataSet, association);
+	if (!vectors || vectors->GetNumberOfComponents() != 3)
+	{
+		// Particles cannot move in this block
+		return;
+	}
+
+	Block block;
+	block.DataSet = dataSet;
+	block.Vectors = vectors;
+	block.InputVectors = vectors;
+	block.AreCellVectors = (association == vtkDataObject::FIELD_ASSOCIATION_CELLS);
+	block.Scalars = this->Mapper->GetInputArrayToProcess(0, dataSet, association);
+	block.InputScalars = block.Scalars;
+	block.AreCellScalars = (association == vtkDataObject::FIELD_ASSOCIATION_CELLS);
+	block.Ghosts = dataSet->GetCellGhostArray();
+	vtkImageData* image = vtkImageData::SafeDownCast(dataSet);
+	block.Image = (image && image->GetDataDimension() == 3) ? image : 0;
+	block.Level = level;
+	// Distributed particles move through the ghost layer of their process
+	// before being sent to the owner of their position, which keeps those
+	// moving along a process boundary from going back and forth
+	block.GhostMask = this->IsDistributed()
+		? vtkDataSetAttributes::HIDDENCELL
+		: vtkDataSetAttributes::DUPLICATECELL | vtkDataSetAttributes::HIDDENCELL;
+	dataSet->GetBounds(block.Bounds);
+	blocks.push_back(block);
+}
+
+//----------------------------------------------------------------------------
+int vtkLIC3DMapper::Private::BuildBoundsTree(const std::vector<double>& bounds,
+	std::vector<int>::iterator first, std::vector<int>::iterator last,
+	std::vector<BoundsNode>& tree)
+{
+	const int nodeId = static_cast<int>(tree.size());
+	tree.push_back(BoundsNode());
+
+	BoundsNode node;
+	vtkBoundingBox bbox;
+	for (std::vector<int>::iterator it = first; it != last; ++it)
+	{
+		bbox.AddBounds(&bounds[6 * *it]);
+	}
+	bbox.GetBounds(node.Bounds);
+	node.Children[0] = node.Children[1] = -1;
+	node.Block = -1;
+
+	if (last - first == 1)
+	{
+		node.Block = *first;
+	}
+	else
+	{
+		// Split the blocks at the median of their centers along the longest axis
+		double lengths[3];
+		bbox.GetLengths(lengths);
+		const int axis = static_cast<int>(std::max_element(lengths, lengths + 3) - lengths);
+		std::vector<int>::iterator middle = first + (last - first) / 2;
+		std::nth_element(first, middle, last, [&bounds, axis](int b1, int b2) {
+			return bounds[6 * b1 + 2 * axis] + bounds[6 * b1 + 2 * axis + 1] <
+				bounds[6 * b2 + 2 * axis] + bounds[6 * b2 + 2 * axis + 1];
+		});
+		node.Children[0] = this->BuildBoundsTree(bounds, first, middle, tree);
+		node.Children[1] = this->BuildBoundsTree(bounds, middle, last, tree);
+	}
+
+	tree[nodeId] = node;
+	return nodeId;
+}
+
+//----------------------------------------------------------------------------
+bool vtkLIC3DMapper::Private::SetData(vtkDataObject* input)
+{
+	// Iterating over a composite input allocates: the blocks are kept as long
+	// as the input, its blocks and the mapper (arrays to process, AMR level)
+	// are not modified
+	bool checked = input && input == this->CheckedInput &&
+		input->GetMTime() <= this->CheckTime.GetMTime() &&
+		this->Mapper->GetMTime() <= this->CheckTime.GetMTime();
+	for (std::size_t b = 0; checked && b < this->Blocks.size(); b++)
+	{
+		checked = this->Blocks[b].DataSet->GetMTime() <= this->CheckTime.GetMTime();
+	}
+	if (checked)
+	{
+		return !this->Blocks.empty();
+	}
+	this->CheckedInput = input;
+	this->CheckTime.Modified();
+
+	std::vector<Block> blocks;
+	vtkCompositeDataSet* composite = vtkCompositeDataSet::SafeDownCast(input);
+	if (composite)
+	{
+		// Blocks are processed natively, keeping the fast FindCell() of the
+		// structured types instead of merging them in an unstructured grid
+		vtkSmartPointer<vtkCompositeDataIterator> iter;
+		iter.TakeReference(composite->NewIterator());
+		vtkUniformGridAMRDataIterator* amrIter = vtkUniformGridAMRDataIterator::SafeDownCast(iter);
+		for (iter->InitTraversal(); !iter->IsDoneWithTraversal(); iter->GoToNextItem())
+		{
+			this->AddBlock(vtkDataSet::SafeDownCast(iter->GetCurrentDataObject()),
+				amrIter ? amrIter->GetCurrentLevel() : 0, blocks);
+		}
+	}
+	else
+	{
+		this->AddBlock(vtkDataSet::SafeDownCast(input), 0, blocks);
+	}
+
+	if (blocks.empty())
+	{
+		if (!this->Blocks.empty())
+		{
+			// Processes without data still take part in the particles exchanges
+			this->Blocks.clear();
+			this->BoundsTree.clear();
+			this->HasScalars = false;
+			this->BlocksBuildTime.Modified();
+		}
+		return false;
+	}
+
+	// Refined cells of an AMR box are only sampled when the finer level is not
+	// used, the particles being handed off to the finest box covering them
+	int finestLevel = 0;
+	for (std::size_t b = 0; b < blocks.size(); b++)
+	{
+		finestLevel = std::max(finestLevel, blocks[b].Level);
+	}
+	for (std::size_t b = 0; b < blocks.size(); b++)
+	{
+		if (blocks[b].Level < finestLevel)
+		{
+			blocks[b].GhostMask |= vtkDataSetAttributes::REFINEDCELL;
+		}
+	}
+
+	// The arrays are compared with the ones of the input, the sampled ones
+	// being copies with NUMAPlacement or left out when incompatible
+	bool sameBlocks = (blocks.size() == this->Blocks.size());
+	bool sameArrays = sameBlocks && this->PlacedArrays == this->Mapper->NUMAPlacement;
+	for (std::size_t b = 0; sameBlocks && b < blocks.size(); b++)
+	{
+		const Block& block = this->Blocks[b];
+		sameBlocks = blocks[b].DataSet == block.DataSet && blocks[b].GhostMask == block.GhostMask &&
+			block.DataSet->GetMTime() <= this->BlocksBuildTime.GetMTime();
+		sameArrays = sameArrays && sameBlocks && blocks[b].InputVectors == block.InputVectors &&
+			blocks[b].InputScalars == block.InputScalars;
+	}
+	if (sameArrays)
+	{
+		return true;
+	}
+
+	if (sameBlocks)
+	{
+		for (std::size_t b = 0; b < blocks.size(); b++)
+		{
+			blocks[b].Locator = this->Blocks[b].Locator;
+		}
+		this->Blocks.swap(blocks);
+	}
+	else
+	{
+		vtkBoundingBox bbox;
+		for (std::size_t b = 0; b < blocks.size(); b++)
+		{
+			int type = blocks[b].DataSet->GetDataObjectType();
+			if (type != VTK_IMAGE_DATA && type != VTK_UNIFORM_GRID && type != VTK_RECTILINEAR_GRID)
+			{
+				// We need a fast cell locator for any type except imagedata and
+				// rectilinear grids where the FindCell() function is fast enough.
+				blocks[b].Locator = vtkSmartPointer<vtkCellLocator>::New();
+				blocks[b].Locator->SetDataSet(blocks[b].DataSet);
+				blocks[b].Locator->BuildLocator();
+			}
+			// Make sure the cell structures are built before the threads read
+			// them
+			blocks[b].DataSet->GetCellPoints(0, this->IdList.Get());
+			bbox.AddBounds(blocks[b].Bounds);
+		}
+		bbox.GetBounds(this->Bounds);
+		this->Blocks.swap(blocks);
+
+		std::vector<int> blockIds(this->Blocks.size());
+		std::vector<double> blockBounds(6 * this->Blocks.size());
+		for (std::size_t b = 0; b < blockIds.size(); b++)
+		{
+			blockIds[b] = static_cast<int>(b);
+			std::copy(this->Blocks[b].Bounds, this->Blocks[b].Bounds + 6, &blockBounds[6 * b]);
+		}
+		this->BoundsTree.clear();
+		this->BuildBoundsTree(blockBounds, blockIds.begin(), blockIds.end(), this->BoundsTree);
+
+		// Images give their spacing, other blocks the smallest edge of the
+		// bounding boxes of their cells: graded meshes have cells much smaller
+		// than their mean one
+		this->MinimumCellSize = 0.;
+		for (std::size_t b = 0; b < this->Blocks.size(); b++)
+		{
+			const Block& block = this->Blocks[b];
+			double size = 0.;
+			if (block.Image)
+			{
+				const double* spacing = block.Image->GetSpacing();
+				for (int a = 0; a < 3; a++)
+				{
+					const double step = std::abs(spacing[a]);
+					size = step > 0. && (size == 0. || step < size) ? step : size;
+				}
+			}
+			else
+			{
+				const vtkIdType nbCells = block.DataSet->GetNumberOfCells();
+				double cellBounds[6];
+				for (vtkIdType cellId = 0; cellId < nbCells; cellId++)
+				{
+					block.DataSet->GetCellBounds(cellId, cellBounds);
+					for (int a = 0; a < 3; a++)
+					{
+						const double length = cellBounds[2 * a + 1] - cellBounds[2 * a];
+						size = length > 0. && (size == 0. || length < size) ? length : size;
+					}
+				}
+			}
+			if (size > 0. && (this->MinimumCellSize == 0. || size < this->MinimumCellSize))
+			{
+				this->MinimumCellSize = size;
+			}
+		}
+
+		std::fill(this->ParticlesBlock.begin(), this->ParticlesBlock.end(), -1);
+		this->BlocksBuildTime.Modified();
+	}
+	this->ClearFlag = true;
+
+	// Bounds the steps of the particles, whether the blocks or only their
+	// vectors changed
+	this->MaximumSpeed = 0.;
+	for (std::size_t b = 0; b < this->Blocks.size(); b++)
+	{
+		this->MaximumSpeed = std::max(this->MaximumSpeed, this->Blocks[b].Vectors->GetMaxNorm());
+	}
+
+	// Particles colors are stored with the type of the first colored block,
+	// blocks with an incompatible array are left uncolored
+	vtkDataArray* scalars = 0;
+	for (std::size_t b = 0; b < this->Blocks.size() && !scalars; b++)
+	{
+		scalars = this->Blocks[b].Scalars;
+	}
+	const int dataType = scalars ? scalars->GetDataType() : VTK_UNSIGNED_CHAR;
+	const int nbComp = scalars ? scalars->GetNumberOfComponents() : 1;
+	for (std::size_t b = 0; b < this->Blocks.size(); b++)
+	{
+		if (this->Blocks[b].Scalars && this->Blocks[b].Scalars->GetNumberOfComponents() != nbComp)
+		{
+			this->Blocks[b].Scalars = 0;
+		}
+	}
+	this->HasScalars = (scalars != 0);
+	this->PlaceBlockArrays();
+	this->ScalarTuple.resize(nbComp);
+	this->MissingScalarTuple.assign(nbComp,
+		(dataType == VTK_FLOAT || dataType == VTK_DOUBLE) ? vtkMath::Nan() : 0.);
+
+	for (int slot = 0; slot < 2; slot++)
+	{
+		if (!this->Scalars[slot] || this->Scalars[slot]->GetDataType() != dataType ||
+			this->Scalars[slot]->GetNumberOfComponents() != nbComp)
+		{
+			this->Scalars[slot].TakeReference(vtkDataArray::CreateDataArray(dataType));
+			this->Scalars[slot]->SetNumberOfComponents(nbComp);
+			this->Scalars[slot]->SetNumberOfTuples(this->ParticlesTTL.size());
+		}
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+int vtkLIC3DMapper::Private::GetNumberOfPlacementRanges()
+{
+	return std::max(1, vtkMultiThreader::GetGlobalDefaultNumberOfThreads());
+}
+
+namespace
+{
+	//----------------------------------------------------------------------------
+	// Copy an array by as many contiguous ranges of values as there are
+	// threads, the pages of the copy being placed on the NUMA node of the thread
+	// first writing them. Only arrays stored as a single buffer are copied.
+	vtkDataArray* NewPlacedArray(vtkDataArray* array, int nbRanges)
+	{
+		const int valueSize = array->GetDataTypeSize();
+		if (!array->HasStandardMemoryLayout() || valueSize == 0)
+		{
+			return 0;
+		}
+		vtkDataArray* placed = array->NewInstance();
+		placed->SetName(array->GetName());
+		placed->SetNumberOfComponents(array->GetNumberOfComponents());
+		placed->SetNumberOfTuples(array->GetNumberOfTuples());
+		const vtkIdType nbValues = array->GetNumberOfValues();
+		const char* source = static_cast<const char*>(array->GetVoidPointer(0));
+		char* target = static_cast<char*>(placed->GetVoidPointer(0));
+		auto copy = [=](vtkIdType begin, vtkIdType end) {
+			for (vtkIdType r = begin; r < end; r++)
+			{
+				const vtkIdType first = nbValues * r / nbRanges;
+				const vtkIdType last = nbValues * (r + 1) / nbRanges;
+				std::memcpy(target + first * valueSize, source + first * valueSize,
+					static_cast<std::size_t>((last - first) * valueSize));
+			}
+		};
+		vtkSMPTools::For(0, nbRanges, 1, copy);
+		return placed;
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::PlaceBlockArrays()
+{
+	// The particles are sorted along the Morton curve, whose highest bit
+	// splits the domain along Z like the last index of the image values: the
+	// first ranges of both are the same part of the domain, and the threads
+	// advecting its particles read the values they placed
+	const bool place = this->Mapper->NUMAPlacement;
+	const int nbRanges = this->GetNumberOfPlacementRanges();
+	for (std::size_t b = 0; b < this->Blocks.size(); b++)
+	{
+		Block& block = this->Blocks[b];
+		block.PlacedVectors = 0;
+		block.PlacedScalars = 0;
+		if (place)
+		{
+			block.PlacedVectors.TakeReference(::NewPlacedArray(block.InputVectors, nbRanges));
+			if (block.Scalars)
+			{
+				block.PlacedScalars.TakeReference(::NewPlacedArray(block.Scalars, nbRanges));
+			}
+		}
+		block.Vectors = block.PlacedVectors ? block.PlacedVectors.Get() : block.InputVectors;
+		if (block.PlacedScalars)
+		{
+			block.Scalars = block.PlacedScalars;
+		}
+	}
+	this->PlacedArrays = place;
+}
+
+//----------------------------------------------------------------------------
+double vtkLIC3DMapper::Private::ComputeOwnedVolume(const Block& block)
+{
+	const unsigned char ghostMask = block.GhostMask | vtkDataSetAttributes::DUPLICATECELL;
+	const vtkIdType nbCells = block.DataSet->GetNumberOfCells();
+	if (block.Image)
+	{
+		vtkIdType nbOwned = nbCells;
+		for (vtkIdType cellId = 0; block.Ghosts && cellId < nbCells; cellId++)
+		{
+			if (block.Ghosts->GetValue(cellId) & ghostMask)
+			{
+				nbOwned--;
+			}
+		}
+		const double* spacing = block.Image->GetSpacing();
+		return nbOwned * std::abs(spacing[0] * spacing[1] * spacing[2]);
+	}
 
-		if (this->ClearFlag)
+	// Sum the volumes of the tetrahedra of the owned 3D cells
+	double volume = 0.;
+	vtkNew<vtkPoints> points;
+	for (vtkIdType cellId = 0; cellId < nbCells; cellId++)
+	{
+		if (block.Ghosts && (block.Ghosts->GetValue(cellId) & ghostMask))
 		{
-			// Clear frame buffer if camera changed
-			glClear(GL_COLOR_BUFFER_BIT);
-			this->CameraMTime = cam->GetMTime();
-			this->ClearFlag = false;
-		}
-
-		this->ShaderCache->ReadyShaderProgram(this->BlendingProgram);
-		vtkNew<vtkOpenGLVertexArrayObject> vaotb;
-		vaotb->Bind();
-		this->FrameTexture->Activate();
-		this->CurrentTexture->Activate();
-		double alpha =
-			1.0 - (1.0 / (this->Mapper->MaxTimeToLive * std::max(0.00001, this->Mapper->Alpha)));
-		this->BlendingProgram->SetUniformf("alpha", alpha);
-		this->BlendingProgram->SetUniformi("prev", this->FrameTexture->GetTextureUnit());
-		this->BlendingProgram->SetUniformi("current", this->CurrentTexture->GetTextureUnit());
-		vtkOpenGLRenderUtilities::RenderQuad(
-			s_quadVerts, s_quadTCoords, this->BlendingProgram, vaotb.Get());
-		this->CurrentTexture->Deactivate();
-		vaotb->Release();
-
-		this->FrameBuffer->UnBind();
-		this->FrameBuffer->RestorePreviousBindingsAndBuffers();
-	}
-	////////////////////////////////////////////////
-	// Pass 3: Finally draw the FBO onto the screen
-	if (!this->ClearFlag)
-	{
-		this->ShaderCache->ReadyShaderProgram(this->TextureProgram);
-		vtkNew<vtkOpenGLVertexArrayObject> vaot;
-		vaot->Bind();
-		this->FrameTexture->Activate();
-		this->TextureProgram->SetUniformi("source", this->FrameTexture->GetTextureUnit());
-		// Setup blending equation
-		int prevBlendParams[4];
-		glGetIntegerv(GL_BLEND_SRC_RGB, &prevBlendParams[0]);
-		glGetIntegerv(GL_BLEND_DST_RGB, &prevBlendParams[1]);
-		glGetIntegerv(GL_BLEND_SRC_ALPHA, &prevBlendParams[2]);
-		glGetIntegerv(GL_BLEND_DST_ALPHA, &prevBlendParams[3]);
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-
-		vtkOpenGLRenderUtilities::RenderQuad(
-			s_quadVerts, s_quadTCoords, this->TextureProgram, vaot.Get());
-
-		// Restore blending equation state
-		glBlendFuncSeparate(
-			prevBlendParams[0], prevBlendParams[1], prevBlendParams[2], prevBlendParams[3]);
-
-		this->FrameTexture->Deactivate();
-		vaot->Release();
+			continue;
+		}
+		block.DataSet->GetCell(cellId, this->GenericCell.Get());
+		if (this->GenericCell->GetCellDimension() != 3)
+		{
+			continue;
+		}
+		this->GenericCell->Triangulate(0, this->IdList.Get(), points.Get());
+		for (vtkIdType t = 0; t + 3 < points->GetNumberOfPoints(); t += 4)
+		{
+			double p[4][3];
+			for (int i = 0; i < 4; i++)
+			{
+				points->GetPoint(t + i, p[i]);
+			}
+			volume += std::abs(vtkTetra::ComputeVolume(p[0], p[1], p[2], p[3]));
+		}
 	}
-	glEnable(GL_DEPTH_TEST);
+	return volume;
 }
 
 //----------------------------------------------------------------------------
-bool vtkLIC3DMapper::Private::PrepareGLBuffers(vtkRenderer* ren, vtkActor* actor)
+bool vtkLIC3DMapper::Private::UpdateDistribution(bool hasData)
 {
-	if (!this->VBOs)
+	if (!this->IsDistributed())
 	{
-		this->VBOs = vtkOpenGLVertexBufferObjectGroup::New();
+		this->GlobalVolume = 0.;
+		this->SeedGhostMask = 0;
+		if (static_cast<vtkIdType>(this->ParticlesTTL.size()) != this->NumberOfRequestedParticles)
+		{
+			this->ResizeParticles(this->NumberOfRequestedParticles);
+		}
+		return hasData;
 	}
-	if (!this->CurrentBuffer)
+
+	// Every process must agree on redistributing the particles, any of them
+	// may have new blocks
+	vtkMultiProcessController* controller = this->Mapper->Controller;
+	int localState[3] = { hasData ? 1 : 0, this->BlocksBuildTime > this->DistributionTime ? 1 : 0,
+		static_cast<int>(this->ScalarTuple.size()) };
+	int globalState[3];
+	controller->AllReduce(localState, globalState, 3, vtkCommunicator::MAX_OP);
+	if (!globalState[0])
 	{
-		this->CurrentBuffer = vtkOpenGLFramebufferObject::New();
+		this->HasCompositeTrails = false;
+		return false;
 	}
-	if (!this->FrameBuffer)
+	if (!globalState[1])
 	{
-		this->FrameBuffer = vtkOpenGLFramebufferObject::New();
+		return true;
 	}
 
-	vtkOpenGLRenderWindow* renWin = vtkOpenGLRenderWindow::SafeDownCast(ren->GetRenderWindow());
-	const int* size = renWin->GetSize();
-	unsigned int width = static_cast<unsigned int>(size[0]);
-	unsigned int height = static_cast<unsigned int>(size[1]);
+	vtkTimerLog::MarkStartEvent("vtkLIC3DMapper::UpdateDistribution");
 
-	if (!this->CurrentTexture)
+	// Each process seeds a share of the particles proportional to the volume
+	// of its cells
+	this->LocalVolume = 0.;
+	for (std::size_t b = 0; b < this->Blocks.size(); b++)
 	{
-		this->CurrentTexture = vtkTextureObject::New();
-		this->CurrentTexture->SetContext(renWin);
+		this->LocalVolume += this->ComputeOwnedVolume(this->Blocks[b]);
+	}
+	controller->AllReduce(&this->LocalVolume, &this->GlobalVolume, 1, vtkCommunicator::SUM_OP);
+
+	// Gather the bounds of the blocks of the other processes, the particles
+	// leaving them all left the domain and are not sent
+	const int nbProcs = controller->GetNumberOfProcesses();
+	const int procId = controller->GetLocalProcessId();
+	std::vector<double> localBounds(6 * this->Blocks.size());
+	for (std::size_t b = 0; b < this->Blocks.size(); b++)
+	{
+		std::copy(this->Blocks[b].Bounds, this->Blocks[b].Bounds + 6, &localBounds[6 * b]);
+	}
+	vtkIdType length = static_cast<vtkIdType>(localBounds.size());
+	std::vector<vtkIdType> lengths(nbProcs);
+	std::vector<vtkIdType> offsets(nbProcs, 0);
+	controller->AllGather(&length, &lengths[0], 1);
+	for (int p = 1; p < nbProcs; p++)
+	{
+		offsets[p] = offsets[p - 1] + lengths[p - 1];
 	}
+	std::vector<double> allBounds(offsets[nbProcs - 1] + lengths[nbProcs - 1] + 1);
+	localBounds.push_back(0.);
+	controller->AllGatherV(&localBounds[0], &allBounds[0], length, &lengths[0], &offsets[0]);
 
-	if (this->CurrentTexture->GetWidth() != width || this->CurrentTexture->GetHeight() != height)
+	this->RemoteBounds.clear();
+	for (int p = 0; p < nbProcs; p++)
 	{
-		this->CurrentTexture->Create2D(width, height, 4, VTK_FLOAT, false);
-		this->ClearFlag = true;
+		if (p != procId)
+		{
+			this->RemoteBounds.insert(this->RemoteBounds.end(), allBounds.begin() + offsets[p],
+				allBounds.begin() + offsets[p] + lengths[p]);
+		}
+	}
+	this->RemoteBoundsTree.clear();
+	if (!this->RemoteBounds.empty())
+	{
+		std::vector<int> blockIds(this->RemoteBounds.size() / 6);
+		for (std::size_t b = 0; b < blockIds.size(); b++)
+		{
+			blockIds[b] = static_cast<int>(b);
+		}
+		this->BuildBoundsTree(
+			this->RemoteBounds, blockIds.begin(), blockIds.end(), this->RemoteBoundsTree);
 	}
 
-	if (!this->FrameTexture)
+	// Position, time to live and scalar tuple, padded to the largest one
+	this->RecordSize = 4 + std::max(1, globalState[2]);
+	this->SeedGhostMask = vtkDataSetAttributes::DUPLICATECELL;
+	// Processes must not draw the same random sequence
+	this->RandomSeed = 1 + procId;
+	this->ResizeParticles(this->GetLocalNumberOfParticles());
+	std::fill(this->ParticlesTTL.begin(), this->ParticlesTTL.end(), 0);
+	this->NumberOfReceivedParticles = 0;
+	this->DistributionTime.Modified();
+
+	vtkTimerLog::MarkEndEvent("vtkLIC3DMapper::UpdateDistribution");
+	return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkLIC3DMapper::Private::IsInRemoteBlock(const double pos[3], Scratch& scratch)
+{
+	if (this->RemoteBoundsTree.empty())
 	{
-		this->FrameTexture = vtkTextureObject::New();
-		this->FrameTexture->SetContext(renWin);
+		return false;
 	}
 
-	if (this->FrameTexture->GetWidth() != width || this->FrameTexture->GetHeight() != height)
+	std::vector<int>& stack = scratch.NodeStack;
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty())
 	{
-		this->FrameTexture->Create2D(width, height, 4, VTK_FLOAT, false);
-		this->ClearFlag = true;
+		const BoundsNode& node = this->RemoteBoundsTree[stack.back()];
+		stack.pop_back();
+		if (!::IsInBounds(pos, node.Bounds))
+		{
+			continue;
+		}
+		if (node.Block >= 0)
+		{
+			return true;
+		}
+		stack.push_back(node.Children[0]);
+		stack.push_back(node.Children[1]);
 	}
+	return false;
+}
 
-	if (!this->ShaderCache)
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::SendParticle(vtkIdType pid, const double pos[3], Scratch& scratch)
+{
+	const std::size_t offset = scratch.SendBuffer.size();
+	scratch.SendBuffer.resize(offset + this->RecordSize, 0.);
+	double* record = &scratch.SendBuffer[offset];
+	std::copy(pos, pos + 3, record);
+	record[3] = this->ParticlesTTL[pid];
+	if (this->HasScalars)
 	{
-		this->ShaderCache = renWin->GetShaderCache();
+		this->Scalars[this->GetHead(pid)]->GetTuple(pid, record + 4);
 	}
+}
 
-	bool prevCreateWideLines = this->CreateWideLines;
-	this->CreateWideLines = actor->GetProperty()->GetLineWidth() > 1.0 &&
-		vtkOpenGLRenderWindow::GetContextSupportsOpenGL32() &&
-		actor->GetProperty()->GetLineWidth() > renWin->GetMaximumHardwareLineWidth();
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::ExchangeParticles()
+{
+	// vtkCommunicator has no all-to-all exchange: the batches of all the
+	// processes are gathered, each process keeping the particles which are in
+	// its own cells
+	vtkMultiProcessController* controller = this->Mapper->Controller;
+	const int nbProcs = controller->GetNumberOfProcesses();
+	const int procId = controller->GetLocalProcessId();
+	vtkIdType length = static_cast<vtkIdType>(this->SendBuffer.size());
+	this->ReceiveLengths.resize(nbProcs);
+	this->ReceiveOffsets.assign(nbProcs, 0);
+	controller->AllGather(&length, &this->ReceiveLengths[0], 1);
+	for (int p = 1; p < nbProcs; p++)
+	{
+		this->ReceiveOffsets[p] = this->ReceiveOffsets[p - 1] + this->ReceiveLengths[p - 1];
+	}
+	const vtkIdType total = this->ReceiveOffsets[nbProcs - 1] + this->ReceiveLengths[nbProcs - 1];
+	if (total > 0)
+	{
+		this->ReceiveBuffer.resize(total);
+		this->SendBuffer.push_back(0.);
+		controller->AllGatherV(&this->SendBuffer[0], &this->ReceiveBuffer[0], length,
+			&this->ReceiveLengths[0], &this->ReceiveOffsets[0]);
+	}
 
-	if (!this->Program || (prevCreateWideLines != this->CreateWideLines))
+	// Received particles take the slots of the ones which died or left, the
+	// ones not fitting are lost
+	Scratch& scratch = this->GetScratch();
+	double pcoords[3];
+	std::size_t nextSlot = 0;
+	for (int p = 0; p < nbProcs && total > 0; p++)
 	{
-		this->ShaderCache->ReleaseCurrentShader();
-		if (this->Program)
+		if (p == procId)
 		{
-			RELEASE_VTKGL_OBJECT(this->Program);
+			continue;
+		}
+		const vtkIdType end = this->ReceiveOffsets[p] + this->ReceiveLengths[p];
+		for (vtkIdType r = this->ReceiveOffsets[p]; r < end && nextSlot < this->FreeSlots.size();
+			 r += this->RecordSize)
+		{
+			double* record = &this->ReceiveBuffer[r];
+			vtkIdType cellId;
+			const int blockId = this->LocateBlock(
+				record, -1, cellId, pcoords, scratch, vtkDataSetAttributes::DUPLICATECELL);
+			if (blockId < 0)
+			{
+				continue;
+			}
+			const vtkIdType pid = this->FreeSlots[nextSlot++];
+			this->ParticlesTTL[pid] = static_cast<int>(record[3]);
+			this->ParticlesBlock[pid] = blockId;
+			this->ParticlesStep[pid] = this->Step;
+			if (this->HasScalars)
+			{
+				this->Scalars[1 - this->GetHead(pid)]->SetTuple(pid, record + 4);
+			}
+			this->AdvanceRing(pid, record, false, scratch);
+			this->NumberOfReceivedParticles++;
 		}
-		this->Program = this->ShaderCache->ReadyShaderProgram(
-			vtkStreamLines_vs, vtkStreamLines_fs, this->CreateWideLines ? vtkStreamLines_gs : "");
-		this->Program->Register(this);
 	}
 
-	if (!this->BlendingProgram)
+	// Remaining slots get new seeds
+	for (; nextSlot < this->FreeSlots.size(); nextSlot++)
 	{
-		this->BlendingProgram =
-			this->ShaderCache->ReadyShaderProgram(vtkTextureObjectVS, vtkStreamLinesBlending_fs, "");
-		this->BlendingProgram->Register(this);
+		this->InitParticle(this->FreeSlots[nextSlot], scratch);
 	}
+	this->FreeSlots.clear();
+	this->SendBuffer.clear();
+}
 
-	if (!this->TextureProgram)
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::Private::EncodeParticles(vtkUnsignedCharArray* stream)
+{
+	vtkTimerLog::MarkStartEvent("vtkLIC3DMapper::EncodeParticles");
+
+	const vtkIdType nbParticles = static_cast<vtkIdType>(this->ParticlesTTL.size());
+	const int nbComp = this->HasScalars ? this->Scalars[0]->GetNumberOfComponents() : 0;
+	std::vector<double> ranges(2 * nbComp);
+	for (int c = 0; c < nbComp; c++)
 	{
-		this->TextureProgram =
-			this->ShaderCache->ReadyShaderProgram(vtkTextureObjectVS, vtkStreamLinesCopy_fs, "");
-		this->TextureProgram->Register(this);
+		double range[2];
+		this->Scalars[0]->GetRange(&ranges[2 * c], c);
+		this->Scalars[1]->GetRange(range, c);
+		ranges[2 * c] = std::min(ranges[2 * c], range[0]);
+		ranges[2 * c + 1] = std::max(ranges[2 * c + 1], range[1]);
 	}
 
-	if (!this->IndexBufferObject)
+	// The deltas of a key frame are taken from 0, so it can be decoded alone
+	const bool keyFrame = this->StreamFrame % this->Mapper->KeyFrameInterval == 0 ||
+		this->StreamPositions.size() != 3 * static_cast<std::size_t>(nbParticles) ||
+		this->StreamScalars.size() != static_cast<std::size_t>(nbComp) * nbParticles ||
+		!std::equal(this->Bounds, this->Bounds + 6, this->StreamBounds);
+	if (keyFrame)
 	{
-		this->IndexBufferObject = vtkOpenGLBufferObject::New();
-		this->IndexBufferObject->SetType(vtkOpenGLBufferObject::ElementArrayBuffer);
+		this->StreamPositions.assign(3 * nbParticles, 0);
+		this->StreamScalars.assign(nbComp * nbParticles, 0);
+		std::copy(this->Bounds, this->Bounds + 6, this->StreamBounds);
 	}
 
-	return this->CurrentTexture && this->FrameTexture && this->ShaderCache && this->Program &&
-		this->BlendingProgram && this->TextureProgram && this->IndexBufferObject;
-}
+	std::vector<unsigned char>& buffer = this->StreamBuffer;
+	buffer.clear();
+	::WriteValue(buffer, vtkLICStreamVersion);
+	::WriteValue(buffer, static_cast<int>(keyFrame));
+	::WriteValue(buffer, this->StreamFrame);
+	::WriteValue(buffer, static_cast<vtkTypeInt64>(nbParticles));
+	::WriteValue(buffer, nbComp);
+	for (int i = 0; i < 6; i++)
+	{
+		::WriteValue(buffer, this->StreamBounds[i]);
+	}
+	for (int i = 0; i < 2 * nbComp; i++)
+	{
+		::WriteValue(buffer, ranges[i]);
+	}
 
-namespace
-{
-	bool HaveArray(vtkFieldData* fd, vtkDataArray* inArray)
+	// One bit per particle whose segment does not start at the end of the
+	// previous one (new seed, particle received from another process...), and
+	// which needs both ends
+	const std::size_t flagsOffset = buffer.size();
+	buffer.resize(flagsOffset + (nbParticles + 7) / 8, 0);
+
+	std::vector<unsigned short> start(3 + nbComp);
+	std::vector<unsigned short> end(3 + nbComp);
+	std::vector<double> tuple(std::max(1, nbComp));
+	for (vtkIdType i = 0; i < nbParticles; i++)
 	{
-		for (int i = 0; i < fd->GetNumberOfArrays(); i++)
+		double pos[3];
+		for (int e = 0; e < 2; e++)
 		{
-			vtkDataArray* arr = fd->GetArray(i);
-			if (arr && arr == inArray)
+			std::vector<unsigned short>& ends = e == 0 ? start : end;
+			const int slot = e == 0 ? this->GetTail(i) : this->GetHead(i);
+			this->Positions[slot]->GetPoint(i, pos);
+			for (int a = 0; a < 3; a++)
 			{
-				return true;
+				ends[a] =
+					::Quantize(pos[a], this->StreamBounds[2 * a], this->StreamBounds[2 * a + 1]);
+			}
+			if (nbComp > 0)
+			{
+				this->Scalars[slot]->GetTuple(i, &tuple[0]);
+			}
+			for (int c = 0; c < nbComp; c++)
+			{
+				ends[3 + c] = ::Quantize(tuple[c], ranges[2 * c], ranges[2 * c + 1]);
 			}
 		}
-		return false;
+
+		unsigned short* lastPosition = &this->StreamPositions[3 * i];
+		unsigned short* lastScalar = nbComp > 0 ? &this->StreamScalars[nbComp * i] : 0;
+		// The zeroed history of a key frame is no previous end, all its segments
+		// have both ends
+		bool continued = !keyFrame && std::equal(lastPosition, lastPosition + 3, start.begin()) &&
+			(nbComp == 0 || std::equal(lastScalar, lastScalar + nbComp, start.begin() + 3));
+		if (!continued)
+		{
+			buffer[flagsOffset + i / 8] |= static_cast<unsigned char>(1 << (i % 8));
+			for (int a = 0; a < 3; a++)
+			{
+				::WriteDelta(buffer, start[a] - lastPosition[a]);
+				lastPosition[a] = start[a];
+			}
+			for (int c = 0; c < nbComp; c++)
+			{
+				::WriteDelta(buffer, start[3 + c] - lastScalar[c]);
+				lastScalar[c] = start[3 + c];
+			}
+		}
+		for (int a = 0; a < 3; a++)
+		{
+			::WriteDelta(buffer, end[a] - lastPosition[a]);
+			lastPosition[a] = end[a];
+		}
+		for (int c = 0; c < nbComp; c++)
+		{
+			::WriteDelta(buffer, end[3 + c] - lastScalar[c]);
+			lastScalar[c] = end[3 + c];
+		}
+	}
+	this->StreamFrame++;
+
+	// Size of the encoded particles, then the compressed particles
+	vtkNew<vtkZLibDataCompressor> compressor;
+	vtkSmartPointer<vtkUnsignedCharArray> compressed;
+	compressed.TakeReference(compressor->Compress(&buffer[0], buffer.size()));
+	const vtkTypeUInt64 size = buffer.size();
+	const vtkIdType compressedSize = compressed ? compressed->GetNumberOfTuples() : 0;
+	stream->SetNumberOfComponents(1);
+	stream->SetNumberOfTuples(sizeof(size) + compressedSize);
+	std::memcpy(stream->GetPointer(0), &size, sizeof(size));
+	if (compressedSize > 0)
+	{
+		std::memcpy(stream->GetPointer(sizeof(size)), compressed->GetPointer(0), compressedSize);
 	}
+
+	vtkTimerLog::MarkEndEvent("vtkLIC3DMapper::EncodeParticles");
 }
 
 //----------------------------------------------------------------------------
-void vtkLIC3DMapper::Private::SetData(
-	vtkDataSet* inData, vtkDataArray* speedField, vtkDataArray* scalars)
+bool vtkLIC3DMapper::Private::DecodeParticles(vtkUnsignedCharArray* stream)
 {
-	std::size_t nbParticles = this->ParticlesTTL.size();
+	vtkTypeUInt64 size;
+	if (!stream || stream->GetNumberOfTuples() <= static_cast<vtkIdType>(sizeof(size)))
+	{
+		return false;
+	}
+	std::memcpy(&size, stream->GetPointer(0), sizeof(size));
+	this->StreamBuffer.resize(size);
+	vtkNew<vtkZLibDataCompressor> compressor;
+	if (size == 0 ||
+		compressor->Uncompress(stream->GetPointer(sizeof(size)),
+			stream->GetNumberOfTuples() - sizeof(size), &this->StreamBuffer[0], size) != size)
+	{
+		return false;
+	}
 
-	if (this->DataSet != inData)
+	const unsigned char* data = &this->StreamBuffer[0];
+	const unsigned char* dataEnd = data + size;
+	int version, keyFrame, frame, nbComp;
+	vtkTypeInt64 nbParticles;
+	if (!::ReadValue(data, dataEnd, version) || version != vtkLICStreamVersion ||
+		!::ReadValue(data, dataEnd, keyFrame) || !::ReadValue(data, dataEnd, frame) ||
+		!::ReadValue(data, dataEnd, nbParticles) || !::ReadValue(data, dataEnd, nbComp) ||
+		nbParticles < 0 || nbComp < 0)
 	{
-		this->AreCellVectors = false;
-		this->AreCellScalars = false;
-		inData->GetBounds(this->Bounds);
-		this->DataSet = inData;
-		this->ClearFlag = true;
-		if (this->Locator)
+		return false;
+	}
+	double bounds[6];
+	std::vector<double> ranges(2 * nbComp);
+	for (int i = 0; i < 6; i++)
+	{
+		if (!::ReadValue(data, dataEnd, bounds[i]))
 		{
-			this->Locator->Delete();
-			this->Locator = 0;
+			return false;
 		}
-		if (inData->GetDataObjectType() != VTK_IMAGE_DATA)
+	}
+	for (int i = 0; i < 2 * nbComp; i++)
+	{
+		if (!::ReadValue(data, dataEnd, ranges[i]))
 		{
-			// We need a fast cell locator for any type except imagedata where
-			// the FindCell() function is fast enough.
-			this->Locator = vtkCellLocator::New();
-			this->Locator->SetDataSet(inData);
-			this->Locator->BuildLocator();
+			return false;
 		}
 	}
-
-	if (this->Vectors != speedField)
+	const unsigned char* flags = data;
+	if ((nbParticles + 7) / 8 > dataEnd - data)
 	{
-		this->Vectors = speedField;
-		this->ClearFlag = true;
-		this->AreCellVectors = ::HaveArray(inData->GetCellData(), speedField);
+		return false;
 	}
+	data += (nbParticles + 7) / 8;
 
-	if (this->Scalars != scalars)
+	// Deltas need the stream just before them
+	if (!keyFrame &&
+		(frame != this->StreamFrame + 1 ||
+			this->StreamPositions.size() != 3 * static_cast<std::size_t>(nbParticles) ||
+			this->StreamScalars.size() != static_cast<std::size_t>(nbComp) * nbParticles))
+	{
+		return false;
+	}
+	if (keyFrame)
 	{
-		if (this->InterpolationScalarArray)
+		this->StreamPositions.assign(3 * nbParticles, 0);
+		this->StreamScalars.assign(nbComp * nbParticles, 0);
+		if (nbParticles != static_cast<vtkTypeInt64>(this->ParticlesTTL.size()))
 		{
-			this->InterpolationScalarArray->Delete();
-			this->InterpolationScalarArray = 0;
+			this->ResizeParticles(static_cast<vtkIdType>(nbParticles));
+			this->ClearFlag = true;
 		}
-		if (scalars)
+		this->HasScalars = nbComp > 0;
+		for (int slot = 0; slot < 2 && this->HasScalars; slot++)
 		{
-			this->InterpolationScalarArray = vtkDataArray::CreateDataArray(scalars->GetDataType());
-			this->AreCellScalars = ::HaveArray(inData->GetCellData(), scalars);
+			if (!vtkFloatArray::SafeDownCast(this->Scalars[slot]) ||
+				this->Scalars[slot]->GetNumberOfComponents() != nbComp)
+			{
+				this->Scalars[slot] = vtkSmartPointer<vtkFloatArray>::New();
+				this->Scalars[slot]->SetNumberOfComponents(nbComp);
+			}
+			this->Scalars[slot]->SetNumberOfTuples(nbParticles);
 		}
-		else
+	}
+	std::copy(bounds, bounds + 6, this->Bounds);
+
+	std::vector<double> tuple(std::max(1, nbComp));
+	for (vtkIdType i = 0; i < nbParticles; i++)
+	{
+		unsigned short* position = &this->StreamPositions[3 * i];
+		unsigned short* scalar = nbComp > 0 ? &this->StreamScalars[nbComp * i] : 0;
+		const bool continued = !(flags[i / 8] & (1 << (i % 8)));
+		// A continued segment starts at the current position of the ring, the
+		// others are written in both slots
+		const int head = continued ? 1 - this->GetHead(i) : 1;
+		for (int e = continued ? 1 : 0; e < 2; e++)
 		{
-			this->InterpolationScalarArray = vtkUnsignedCharArray::New();
+			const int slot = e == 0 ? 1 - head : head;
+			double pos[3];
+			for (int a = 0; a < 3; a++)
+			{
+				int delta;
+				if (!::ReadDelta(data, dataEnd, delta))
+				{
+					return false;
+				}
+				position[a] = static_cast<unsigned short>(position[a] + delta);
+				pos[a] = ::Dequantize(position[a], bounds[2 * a], bounds[2 * a + 1]);
+			}
+			for (int c = 0; c < nbComp; c++)
+			{
+				int delta;
+				if (!::ReadDelta(data, dataEnd, delta))
+				{
+					return false;
+				}
+				scalar[c] = static_cast<unsigned short>(scalar[c] + delta);
+				tuple[c] = ::Dequantize(scalar[c], ranges[2 * c], ranges[2 * c + 1]);
+			}
+			this->Positions[slot]->SetPoint(i, pos);
+			if (nbComp > 0)
+			{
+				this->Scalars[slot]->SetTuple(i, &tuple[0]);
+			}
 		}
-		this->InterpolationScalarArray->SetNumberOfComponents(
-			scalars ? scalars->GetNumberOfComponents() : 1);
-		this->InterpolationScalarArray->SetNumberOfTuples(nbParticles * 2);
-		this->Scalars = scalars;
-		this->ClearFlag = true;
+		this->ParticlesRing[i] = static_cast<unsigned char>(head | RingHasPrevious);
 	}
-
-	if (!this->InterpolationArray ||
-		(this->InterpolationArray &&
-			this->InterpolationArray->GetDataType() != speedField->GetDataType()))
+	for (int slot = 0; slot < 2; slot++)
 	{
-		if (this->InterpolationArray)
+		this->Positions[slot]->Modified();
+		if (nbComp > 0)
 		{
-			this->InterpolationArray->Delete();
-			this->InterpolationArray = 0;
+			this->Scalars[slot]->Modified();
 		}
-		this->InterpolationArray = vtkDataArray::CreateDataArray(speedField->GetDataType());
-		this->InterpolationArray->SetNumberOfComponents(3);
-		this->InterpolationArray->SetNumberOfTuples(1);
 	}
+	this->StreamFrame = frame;
+	this->HasDecodedParticles = true;
+	return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkLIC3DMapper::Private::GetParticleSegment(vtkIdType pid, double start[3], double end[3])
+{
+	if (pid < 0 || pid >= static_cast<vtkIdType>(this->ParticlesRing.size()))
+	{
+		return false;
+	}
+	this->Positions[this->GetTail(pid)]->GetPoint(pid, start);
+	this->Positions[this->GetHead(pid)]->GetPoint(pid, end);
+	return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkLIC3DMapper::Private::SetParticleSegment(
+	vtkIdType pid, const double start[3], const double end[3])
+{
+	if (pid < 0 || pid >= static_cast<vtkIdType>(this->ParticlesRing.size()))
+	{
+		return false;
+	}
+	const int head = this->GetHead(pid);
+	this->Positions[1 - head]->SetPoint(pid, start);
+	this->Positions[head]->SetPoint(pid, end);
+	this->ParticlesRing[pid] = static_cast<unsigned char>(head | RingHasPrevious);
+	this->Positions[0]->Modified();
+	this->Positions[1]->Modified();
+	return true;
 }
 
 //-----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkLIC3DMapper)
+vtkCxxSetObjectMacro(vtkLIC3DMapper, Controller, vtkMultiProcessController);
 
 //-----------------------------------------------------------------------------
 vtkLIC3DMapper::vtkLIC3DMapper()
@@ -742,12 +3107,30 @@ vtkLIC3DMapper::vtkLIC3DMapper()
 	this->Internal = Private::New();
 	this->Internal->SetMapper(this);
 	this->Animate = true;
+	this->ReprojectTrails = false;
+	this->MaximumReprojectionAngle = 15.;
+	this->WarmUp = false;
+	this->WarmUpTimeBudget = 0.5;
+	this->Interactive = false;
+	this->InteractiveParticleFraction = 0.25;
+	this->InteractiveResolutionFactor = 0.5;
+	this->UpdateFraction = 1.;
 	this->Alpha = 0.95;
 	this->StepLength = 0.01;
 	this->MaxTimeToLive = 600;
 	this->NumberOfParticles = 0;
+	this->DrawChunkSize = 1 << 20;
+	this->QuantizePositions = false;
+	this->PositionQuantizationError = 0.;
 	this->NumberOfAnimationSteps = 1;
 	this->AnimationSteps = 0;
+	this->MaximumAMRLevel = VTK_INT_MAX;
+	this->SortInterval = 100;
+	this->NUMAPlacement = false;
+	this->RemoteAdvection = false;
+	this->KeyFrameInterval = 30;
+	this->Controller = 0;
+	this->SetController(vtkMultiProcessController::GetGlobalController());
 	this->SetNumberOfParticles(1000);
 
 	this->SetInputArrayToProcess(
@@ -760,11 +3143,12 @@ vtkLIC3DMapper::vtkLIC3DMapper()
 
 vtkLIC3DMapper::~vtkLIC3DMapper()
 {
+	this->SetController(0);
 	this->Internal->Delete();
 }
 
 //----------------------------------------------------------------------------
-void vtkLIC3DMapper::SetNumberOfParticles(int nbParticles)
+void vtkLIC3DMapper::SetNumberOfParticles(vtkIdType nbParticles)
 {
 	if (this->NumberOfParticles == nbParticles)
 	{
@@ -775,6 +3159,12 @@ void vtkLIC3DMapper::SetNumberOfParticles(int nbParticles)
 	this->Modified();
 }
 
+//----------------------------------------------------------------------------
+unsigned long vtkLIC3DMapper::EstimateMemorySize(vtkIdType nbParticles)
+{
+	return this->Internal->EstimateMemorySize(nbParticles);
+}
+
 //----------------------------------------------------------------------------
 void vtkLIC3DMapper::SetAnimate(bool animate)
 {
@@ -786,31 +3176,103 @@ void vtkLIC3DMapper::SetAnimate(bool animate)
 	}
 }
 
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::AdvectParticles()
+{
+	const bool hasData = this->Internal->SetData(this->GetInputDataObject(0, 0));
+	if (this->Internal->UpdateDistribution(hasData) && this->Animate)
+	{
+		this->Internal->UpdateParticles();
+	}
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkLIC3DMapper::GetNumberOfReceivedParticles()
+{
+	return this->Internal->IsDistributed() ? this->Internal->GetNumberOfReceivedParticles() : 0;
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::EncodeParticles(vtkUnsignedCharArray* stream)
+{
+	this->Internal->EncodeParticles(stream);
+}
+
+//----------------------------------------------------------------------------
+bool vtkLIC3DMapper::DecodeParticles(vtkUnsignedCharArray* stream)
+{
+	return this->Internal->DecodeParticles(stream);
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::GetParticleSegment(vtkIdType pid, double start[3], double end[3])
+{
+	if (!this->Internal->GetParticleSegment(pid, start, end))
+	{
+		vtkErrorMacro(<< "Invalid particle " << pid);
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::SetParticleSegment(vtkIdType pid, const double start[3], const double end[3])
+{
+	if (!this->Internal->SetParticleSegment(pid, start, end))
+	{
+		vtkErrorMacro(<< "Invalid particle " << pid);
+	}
+}
+
 //----------------------------------------------------------------------------
 void vtkLIC3DMapper::Render(vtkRenderer* ren, vtkActor* actor)
 {
-	vtkDataSet* inData = vtkDataSet::SafeDownCast(this->GetInput());
+	if (this->RemoteAdvection)
+	{
+		// Each decoded stream is one step of the animation
+		if (this->Internal->HasDecodedStream())
+		{
+			this->Internal->DrawParticles(
+				ren, actor, this->Animate && this->Internal->ConsumeDecodedParticles());
+		}
+		return;
+	}
 
-	if (!inData || inData->GetNumberOfCells() == 0)
+	if (this->Internal->IsDistributed())
 	{
+		// Advected, drawn and composited by UpdateDistributedTrails() on all the
+		// processes: the ones whose prop is culled do not render, so rendering
+		// must not communicate
+		this->Internal->PresentCompositeTrails();
 		return;
 	}
 
-	vtkDataArray* inScalars =
-		this->GetInputArrayToProcess(0, 0, this->GetExecutive()->GetInputInformation());
+	this->AdvectAndDraw(ren, actor);
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::UpdateDistributedTrails(vtkRenderer* ren, vtkActor* actor)
+{
+	if (this->RemoteAdvection || !this->Internal->IsDistributed())
+	{
+		return;
+	}
 
-	vtkDataArray* inVectors =
-		this->GetInputArrayToProcess(1, 0, this->GetExecutive()->GetInputInformation());
+	// The trails are drawn outside of the render of the window
+	ren->GetRenderWindow()->MakeCurrent();
+	this->AdvectAndDraw(ren, actor);
+}
 
-	if (!inVectors || inVectors->GetNumberOfComponents() != 3)
+//----------------------------------------------------------------------------
+void vtkLIC3DMapper::AdvectAndDraw(vtkRenderer* ren, vtkActor* actor)
+{
+	// Set processing blocks and arrays. Distributed processes without data
+	// still advect to exchange particles with the others.
+	const bool hasData = this->Internal->SetData(this->GetInputDataObject(0, 0));
+	if (!this->Internal->UpdateDistribution(hasData))
 	{
 		vtkDebugMacro(<< "No speed field vector to process!");
 		return;
 	}
 
-	// Set processing dataset and arrays
-	this->Internal->SetData(inData, inVectors, inScalars);
-
 	bool animate = true;
 	for (int i = 0; i < this->NumberOfAnimationSteps && animate; i++)
 	{
@@ -828,8 +3290,52 @@ void vtkLIC3DMapper::Render(vtkRenderer* ren, vtkActor* actor)
 		}
 
 		// Draw updated particles in a buffer
-		this->Internal->DrawParticles(ren, actor, animate);
+		if (hasData)
+		{
+			this->Internal->DrawParticles(ren, actor, animate);
+		}
+	}
+	if (this->Internal->IsDistributed())
+	{
+		this->Internal->CompositeTrails(ren, hasData);
+	}
+}
+
+//----------------------------------------------------------------------------
+double* vtkLIC3DMapper::GetBounds()
+{
+	vtkCompositeDataSet* input = vtkCompositeDataSet::SafeDownCast(this->GetInputDataObject(0, 0));
+	if (!input)
+	{
+		return this->Superclass::GetBounds();
+	}
+
+	if (!this->Static)
+	{
+		this->Update();
+	}
+
+	vtkBoundingBox bbox;
+	vtkSmartPointer<vtkCompositeDataIterator> iter;
+	iter.TakeReference(input->NewIterator());
+	for (iter->InitTraversal(); !iter->IsDoneWithTraversal(); iter->GoToNextItem())
+	{
+		vtkDataSet* block = vtkDataSet::SafeDownCast(iter->GetCurrentDataObject());
+		if (block && block->GetNumberOfCells() > 0)
+		{
+			bbox.AddBounds(block->GetBounds());
+		}
+	}
+
+	if (bbox.IsValid())
+	{
+		bbox.GetBounds(this->Bounds);
+	}
+	else
+	{
+		vtkMath::UninitializeBounds(this->Bounds);
 	}
+	return this->Bounds;
 }
 
 //----------------------------------------------------------------------------
@@ -842,6 +3348,7 @@ void vtkLIC3DMapper::ReleaseGraphicsResources(vtkWindow* renWin)
 int vtkLIC3DMapper::FillInputPortInformation(int vtkNotUsed(port), vtkInformation* info)
 {
 	info->Set(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkDataSet");
+	info->Append(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkCompositeDataSet");
 	return 1;
 }
 
@@ -853,5 +3360,22 @@ void vtkLIC3DMapper::PrintSelf(ostream& os, vtkIndent indent)
 	os << indent << "Alpha : " << this->Alpha << endl;
 	os << indent << "StepLength : " << this->StepLength << endl;
 	os << indent << "NumberOfParticles: " << this->NumberOfParticles << endl;
+	os << indent << "DrawChunkSize: " << this->DrawChunkSize << endl;
+	os << indent << "QuantizePositions: " << this->QuantizePositions << endl;
+	os << indent << "PositionQuantizationError: " << this->PositionQuantizationError << endl;
 	os << indent << "MaxTimeToLive: " << this->MaxTimeToLive << endl;
+	os << indent << "ReprojectTrails: " << this->ReprojectTrails << endl;
+	os << indent << "MaximumReprojectionAngle: " << this->MaximumReprojectionAngle << endl;
+	os << indent << "WarmUp: " << this->WarmUp << endl;
+	os << indent << "WarmUpTimeBudget: " << this->WarmUpTimeBudget << endl;
+	os << indent << "Interactive: " << this->Interactive << endl;
+	os << indent << "InteractiveParticleFraction: " << this->InteractiveParticleFraction << endl;
+	os << indent << "InteractiveResolutionFactor: " << this->InteractiveResolutionFactor << endl;
+	os << indent << "UpdateFraction: " << this->UpdateFraction << endl;
+	os << indent << "MaximumAMRLevel: " << this->MaximumAMRLevel << endl;
+	os << indent << "SortInterval: " << this->SortInterval << endl;
+	os << indent << "NUMAPlacement: " << this->NUMAPlacement << endl;
+	os << indent << "Controller: " << this->Controller << endl;
+	os << indent << "RemoteAdvection: " << this->RemoteAdvection << endl;
+	os << indent << "KeyFrameInterval: " << this->KeyFrameInterval << endl;
 }
\ No newline at end of file
@@ -6,7 +6,9 @@
 class vtkActor;
 class vtkDataSet;
 class vtkImageData;
+class vtkMultiProcessController;
 class vtkRenderer;
+class vtkUnsignedCharArray;
 
 class VTK_EXPORT vtkLIC3DMapper : public vtkMapper
 {
@@ -48,10 +50,52 @@ public:
 	* Get/Set the number of particles.
 	* Default is 1000.
 	*/
-	void SetNumberOfParticles(int);
-	vtkGetMacro(NumberOfParticles, int);
+	void SetNumberOfParticles(vtkIdType);
+	vtkGetMacro(NumberOfParticles, vtkIdType);
+	//@}
+
+	/**
+	* Return an estimate of the host memory (in KiB) the particles would use
+	* with nbParticles of them, from the scalars of the current input and the
+	* sort and update settings, so that a count can be checked before it is
+	* allocated. The trail buffers and the buffers of the GL are not included.
+	*/
+	unsigned long EstimateMemorySize(vtkIdType nbParticles);
+
+	//@{
+	/**
+	* Get/Set the number of particles whose segments are uploaded and drawn at
+	* once. Larger numbers of particles are drawn by several chunks of this
+	* size, so that the vertex buffers keep a bounded size. The GL counts
+	* vertices and colors components with ints, so a chunk has at most
+	* VTK_INT_MAX / 4 particles. Default is 1048576.
+	*/
+	vtkSetClampMacro(DrawChunkSize, vtkIdType, 1, VTK_INT_MAX / 4);
+	vtkGetMacro(DrawChunkSize, vtkIdType);
 	//@}
 
+	//@{
+	/**
+	* Get/Set whether the particle positions are uploaded as 16 bits
+	* coordinates relative to the bounds of the data, half the size of floats.
+	* The bounds are padded by the longest step of a particle, so that the
+	* segments leaving the data are not clamped. The positions are uploaded as
+	* floats anyway when the quantization step of the padded bounds exceeds a
+	* tenth of the smallest spacing of the image blocks, or of the smallest
+	* bounding box edge of the cells of the other blocks.
+	* Default is false.
+	*/
+	vtkSetMacro(QuantizePositions, bool);
+	vtkGetMacro(QuantizePositions, bool);
+	vtkBooleanMacro(QuantizePositions, bool);
+	//@}
+
+	/**
+	* Get the largest distance between a particle and its quantized position
+	* in the last render, 0 when the positions were uploaded as floats.
+	*/
+	vtkGetMacro(PositionQuantizationError, double);
+
 	//@{
 	/**
 	* Get/Set the maximum number of iteration before particles die.
@@ -70,6 +114,218 @@ public:
 	vtkGetMacro(NumberOfAnimationSteps, int);
 	//@}
 
+	//@{
+	/**
+	* Get/Set whether the accumulated trails are reprojected into the new view
+	* when the camera moves instead of being cleared. A depth value is kept
+	* alongside the trail colors to do so. Default is false.
+	*/
+	vtkSetMacro(ReprojectTrails, bool);
+	vtkGetMacro(ReprojectTrails, bool);
+	vtkBooleanMacro(ReprojectTrails, bool);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the maximum camera rotation (in degrees) for which the trails are
+	* reprojected. Larger rotations, as well as zoom factors above 1.5, fall
+	* back to clearing the trails. Default is 15.
+	*/
+	vtkSetClampMacro(MaximumReprojectionAngle, double, 0., 180.);
+	vtkGetMacro(MaximumReprojectionAngle, double);
+	//@}
+
+	//@{
+	/**
+	* Get/Set whether the trails are brought to their steady state right after
+	* they have been cleared by new data, a resize or an actor change, by
+	* running up to MaxTimeToLive * Alpha advection steps before presenting the
+	* frame. Clears caused by camera moves are not warmed up, so that
+	* interaction is never held back by the time budget.
+	* Ignored when the particles are distributed over several processes, which
+	* would not run the same number of steps within the time budget.
+	* Default is false.
+	*/
+	vtkSetMacro(WarmUp, bool);
+	vtkGetMacro(WarmUp, bool);
+	vtkBooleanMacro(WarmUp, bool);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the maximum time (in seconds) spent warming the trails up.
+	* Default is 0.5.
+	*/
+	vtkSetClampMacro(WarmUpTimeBudget, double, 0., VTK_DOUBLE_MAX);
+	vtkGetMacro(WarmUpTimeBudget, double);
+	//@}
+
+	//@{
+	/**
+	* Get/Set whether the mapper renders an interactive (level of detail)
+	* frame, using only InteractiveParticleFraction of the particles and
+	* buffers reduced by InteractiveResolutionFactor. This is typically turned
+	* on by the representation while the camera moves. Default is false.
+	*/
+	vtkSetMacro(Interactive, bool);
+	vtkGetMacro(Interactive, bool);
+	vtkBooleanMacro(Interactive, bool);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the fraction of particles advected and drawn for interactive
+	* frames. Default is 0.25.
+	*/
+	vtkSetClampMacro(InteractiveParticleFraction, double, 0., 1.);
+	vtkGetMacro(InteractiveParticleFraction, double);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the resolution factor of the trail buffers for interactive
+	* frames. Default is 0.5.
+	*/
+	vtkSetClampMacro(InteractiveResolutionFactor, double, 0.1, 1.);
+	vtkGetMacro(InteractiveResolutionFactor, double);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the finest level of AMR inputs used to move the particles. Finer
+	* boxes are ignored and the coarser levels sampled instead, trading accuracy
+	* for speed. Default is VTK_INT_MAX (all levels).
+	*/
+	vtkSetClampMacro(MaximumAMRLevel, int, 0, VTK_INT_MAX);
+	vtkGetMacro(MaximumAMRLevel, int);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the number of advection steps between two sorts of the particles
+	* by the Morton code of their position, which keeps the particles close in
+	* space close in memory for the cell lookups. 0 disables the sorts.
+	* Default is 100.
+	*/
+	vtkSetClampMacro(SortInterval, int, 0, VTK_INT_MAX);
+	vtkGetMacro(SortInterval, int);
+	//@}
+
+	//@{
+	/**
+	* Get/Set whether the field and the particles are placed on the threads
+	* for NUMA nodes. The vectors and scalars are copied by as many contiguous
+	* ranges as there are threads, each page being placed on the node of the
+	* thread first writing it, and each thread advects a static range of the
+	* particles sorted by position instead of dynamic ones. Both are ordered
+	* along Z first, so a thread mostly reads the values of its node. This
+	* relies on the threads keeping their range between calls, as the OpenMP
+	* backend does with OMP_PROC_BIND and a static OMP_SCHEDULE, and doubles
+	* the memory of the field. Default is off.
+	*/
+	vtkSetMacro(NUMAPlacement, bool);
+	vtkGetMacro(NUMAPlacement, bool);
+	vtkBooleanMacro(NUMAPlacement, bool);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the fraction of the particles advected at each step. Below 1,
+	* every 1/UpdateFraction-th particle is advected, the next ones at the next
+	* step, and a particle moves for all the steps elapsed since its last
+	* update. Its segment is drawn at every step until the next update, faded
+	* by its age, so that trails keep their intensity. This bounds the cost of
+	* a step for very large numbers of particles. Default is 1.
+	*/
+	vtkSetClampMacro(UpdateFraction, double, 0.01, 1.);
+	vtkGetMacro(UpdateFraction, double);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the controller of the processes the input is distributed over.
+	* With several processes, each one seeds a share of the NumberOfParticles
+	* proportional to the volume of its cells, and the particles leaving the
+	* local data are sent to the process owning their new position at every
+	* step. The advection and the compositing of the trails are then done by
+	* UpdateDistributedTrails(), which all the processes must call before each
+	* render. Default is the global controller.
+	*/
+	virtual void SetController(vtkMultiProcessController*);
+	vtkGetObjectMacro(Controller, vtkMultiProcessController);
+	//@}
+
+	//@{
+	/**
+	* Get/Set whether the particles are advected by another mapper, typically
+	* on a server, and given to this one with DecodeParticles(). Renders then
+	* only draw the particles, each decoded stream being one animation step.
+	* Default is false.
+	*/
+	vtkSetMacro(RemoteAdvection, bool);
+	vtkGetMacro(RemoteAdvection, bool);
+	vtkBooleanMacro(RemoteAdvection, bool);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the number of streams of EncodeParticles() between two key
+	* frames, which can be decoded without the previous streams. Default is 30.
+	*/
+	vtkSetClampMacro(KeyFrameInterval, int, 1, VTK_INT_MAX);
+	vtkGetMacro(KeyFrameInterval, int);
+	//@}
+
+	/**
+	* Advect the particles one step without rendering them, for a mapper whose
+	* particles are drawn elsewhere from EncodeParticles(). This is a
+	* collective operation when the input is distributed.
+	*/
+	void AdvectParticles();
+
+	/**
+	* Advect and draw the particles of an input distributed over several
+	* processes, then composite the trails of all of them. This is a collective
+	* operation, which every process must call before each render of ren, even
+	* when its prop is culled or its piece is empty, typically from a view pass
+	* running on all of them (REQUEST_RENDER in ParaView). Render() then only
+	* draws the composited trails and never communicates. Does nothing when the
+	* input is not distributed.
+	*/
+	void UpdateDistributedTrails(vtkRenderer* ren, vtkActor* actor);
+
+	/**
+	* Return the number of particles this process received from the other
+	* ones since the particles were last distributed between them, 0 when the
+	* input is not distributed.
+	*/
+	vtkIdType GetNumberOfReceivedParticles();
+
+	/**
+	* Encode the particle segments of the last step in stream. Positions and
+	* scalars are quantized to 16 bits, delta encoded against the previous
+	* stream and compressed with zlib, a segment continuing the previous one
+	* only costing its new end.
+	*/
+	void EncodeParticles(vtkUnsignedCharArray* stream);
+
+	/**
+	* Decode a stream of EncodeParticles() into the particles drawn by the
+	* next render. Return false when the stream cannot be decoded, for
+	* instance a delta following a lost stream, until the next key frame.
+	*/
+	bool DecodeParticles(vtkUnsignedCharArray* stream);
+
+	//@{
+	/**
+	* WARNING: INTERNAL METHOD - NOT INTENDED FOR GENERAL USE
+	* Get/Set the segment of particle pid drawn by the next render, from start
+	* to end. Used to test the streams of EncodeParticles().
+	*/
+	void GetParticleSegment(vtkIdType pid, double start[3], double end[3]);
+	void SetParticleSegment(vtkIdType pid, const double start[3], const double end[3]);
+	//@}
+
 	/**
 	* Returns if the mapper does not expect to have translucent geometry. This
 	* may happen when using ColorMode is set to not map scalars i.e. render the
@@ -80,6 +336,15 @@ public:
 	*/
 	bool GetIsOpaque() VTK_OVERRIDE { return true; }
 
+	//@{
+	/**
+	* Standard vtkProp method to get 3D bounds of a 3D prop. Composite inputs
+	* are handled by merging the bounds of their blocks.
+	*/
+	double* GetBounds() VTK_OVERRIDE;
+	void GetBounds(double bounds[6]) VTK_OVERRIDE { this->Superclass::GetBounds(bounds); }
+	//@}
+
 	/**
 	* WARNING: INTERNAL METHOD - NOT INTENDED FOR GENERAL USE
 	* DO NOT USE THIS METHOD OUTSIDE OF THE RENDERING PROCESS
@@ -101,17 +366,38 @@ protected:
 	// Rendering parameter variable
 	double Alpha;
 	double StepLength;
+	double MaximumReprojectionAngle;
+	double WarmUpTimeBudget;
+	double InteractiveParticleFraction;
+	double InteractiveResolutionFactor;
+	double UpdateFraction;
 	int MaxTimeToLive;
-	int NumberOfParticles;
+	vtkIdType NumberOfParticles;
+	vtkIdType DrawChunkSize;
+	double PositionQuantizationError;
 	int NumberOfAnimationSteps;
 	int AnimationSteps;
+	int MaximumAMRLevel;
+	int SortInterval;
 	bool Animate;
+	bool ReprojectTrails;
+	bool WarmUp;
+	bool Interactive;
+	bool RemoteAdvection;
+	bool QuantizePositions;
+	bool NUMAPlacement;
+	int KeyFrameInterval;
+	vtkMultiProcessController* Controller;
 
 	class Private;
 	Private* Internal;
 
 	friend class Private;
 
+	// Advance the animation and draw the particles in the trails, compositing
+	// them when the input is distributed
+	void AdvectAndDraw(vtkRenderer*, vtkActor*);
+
 	// see algorithm for more info
 	int FillInputPortInformation(int port, vtkInformation* info) VTK_OVERRIDE;
 
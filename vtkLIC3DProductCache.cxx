@@ -0,0 +1,100 @@
+#include "vtkLIC3DProductCache.h"
+
+#include "vtkDataObject.h"
+#include "vtkObjectFactory.h"
+
+vtkStandardNewMacro(vtkLIC3DProductCache);
+
+//----------------------------------------------------------------------------
+vtkLIC3DProductCache::vtkLIC3DProductCache()
+{
+	this->MemoryLimit = 1024 * 1024;
+	this->MemorySize = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkLIC3DProductCache::~vtkLIC3DProductCache()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DProductCache::SetMemoryLimit(unsigned long limit)
+{
+	if (this->MemoryLimit != limit)
+	{
+		this->MemoryLimit = limit;
+		this->Trim();
+		this->Modified();
+	}
+}
+
+//----------------------------------------------------------------------------
+vtkDataObject* vtkLIC3DProductCache::GetProduct(
+	const char* name, double cacheKey, vtkMTimeType time)
+{
+	std::map<ProductKey, std::list<Product>::iterator>::iterator it =
+		this->Index.find(ProductKey(name, cacheKey));
+	if (it == this->Index.end() || it->second->Time != time)
+	{
+		return NULL;
+	}
+	this->Products.splice(this->Products.begin(), this->Products, it->second);
+	return it->second->Data;
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DProductCache::AddProduct(
+	const char* name, double cacheKey, vtkMTimeType time, vtkDataObject* data)
+{
+	const ProductKey key(name, cacheKey);
+	std::map<ProductKey, std::list<Product>::iterator>::iterator it = this->Index.find(key);
+	if (it != this->Index.end())
+	{
+		this->MemorySize -= it->second->Size;
+		this->Products.erase(it->second);
+		this->Index.erase(it);
+	}
+	if (!data)
+	{
+		return;
+	}
+
+	Product product;
+	product.Key = key;
+	product.Time = time;
+	product.Size = data->GetActualMemorySize();
+	product.Data = data;
+	this->Products.push_front(product);
+	this->Index[key] = this->Products.begin();
+	this->MemorySize += product.Size;
+	this->Trim();
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DProductCache::RemoveAllProducts()
+{
+	this->Products.clear();
+	this->Index.clear();
+	this->MemorySize = 0;
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DProductCache::Trim()
+{
+	while (!this->Products.empty() && this->MemorySize > this->MemoryLimit)
+	{
+		const Product& product = this->Products.back();
+		this->MemorySize -= product.Size;
+		this->Index.erase(product.Key);
+		this->Products.pop_back();
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DProductCache::PrintSelf(ostream& os, vtkIndent indent)
+{
+	this->Superclass::PrintSelf(os, indent);
+	os << indent << "MemoryLimit: " << this->MemoryLimit << endl;
+	os << indent << "MemorySize: " << this->MemorySize << endl;
+	os << indent << "NumberOfProducts: " << this->Products.size() << endl;
+}
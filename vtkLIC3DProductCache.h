@@ -0,0 +1,98 @@
+/**
+* @class   vtkLIC3DProductCache
+* @brief   bounded cache of the data derived from cached inputs
+*
+* vtkLIC3DProductCache keeps data objects computed from the input of a
+* representation, like tetrahedralizations, LIC volumes or resampled images,
+* so that they are not computed again when vtkPVCacheKeeper serves a cached
+* input, for instance while looping over the time steps of an animation.
+*
+* Products are identified by a name, the cache key (time) of the input they
+* were computed from, and a modification time of the parameters used to
+* compute them. When the products use more than MemoryLimit, the least
+* recently used ones are released.
+*
+* The cache keeps references to the data objects it is given: they must not
+* be modified afterwards, a shallow copy of a filter output should be given.
+*/
+
+#ifndef vtkLIC3DProductCache_h
+#define vtkLIC3DProductCache_h
+
+#include "vtkObject.h"
+
+#include "vtkSmartPointer.h" // for vtkSmartPointer
+
+#include <list>   // for std::list
+#include <map>    // for std::map
+#include <string> // for std::string
+
+class vtkDataObject;
+
+class VTK_EXPORT vtkLIC3DProductCache : public vtkObject
+{
+public:
+	static vtkLIC3DProductCache* New();
+	vtkTypeMacro(vtkLIC3DProductCache, vtkObject);
+	void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+	//@{
+	/**
+	* Get/Set the memory (in KiB) the products may use. 0 disables the cache.
+	* Default is 1 GiB.
+	*/
+	void SetMemoryLimit(unsigned long);
+	vtkGetMacro(MemoryLimit, unsigned long);
+	//@}
+
+	/**
+	* Get the memory (in KiB) used by the products.
+	*/
+	vtkGetMacro(MemorySize, unsigned long);
+
+	/**
+	* Return the product computed from the input of a cache key with
+	* parameters modified at time, or NULL if it is not cached. The product
+	* becomes the most recently used one.
+	*/
+	vtkDataObject* GetProduct(const char* name, double cacheKey, vtkMTimeType time);
+
+	/**
+	* Keep a product, replacing the one of the same name and cache key, then
+	* release the least recently used products over the memory limit.
+	*/
+	void AddProduct(const char* name, double cacheKey, vtkMTimeType time, vtkDataObject* data);
+
+	/**
+	* Release all the products.
+	*/
+	void RemoveAllProducts();
+
+protected:
+	vtkLIC3DProductCache();
+	~vtkLIC3DProductCache() override;
+
+	void Trim();
+
+	typedef std::pair<std::string, double> ProductKey;
+	struct Product
+	{
+		ProductKey Key;
+		vtkMTimeType Time;
+		unsigned long Size;
+		vtkSmartPointer<vtkDataObject> Data;
+	};
+
+	// Products from the most to the least recently used, indexed by key
+	std::list<Product> Products;
+	std::map<ProductKey, std::list<Product>::iterator> Index;
+
+	unsigned long MemoryLimit;
+	unsigned long MemorySize;
+
+private:
+	vtkLIC3DProductCache(const vtkLIC3DProductCache&) = delete;
+	void operator=(const vtkLIC3DProductCache&) = delete;
+};
+
+#endif
@@ -0,0 +1,154 @@
+/**
+* @class   vtkLIC3DRadixSort
+* @brief   parallel radix sort of 32 bits keys
+*
+* vtkLIC3DRadixSort sorts (key, value) pairs by increasing unsigned 32 bits
+* keys with a least significant digit radix sort, 8 bits per pass. Each pass
+* builds the digit histograms of fixed chunks of the arrays in parallel with
+* vtkSMPTools, then scatters the chunks in parallel, which keeps the sort
+* stable whatever the number of threads.
+*
+* Floating point values are turned into keys of the same order with
+* FloatToKey().
+*/
+
+#ifndef vtkLIC3DRadixSort_h
+#define vtkLIC3DRadixSort_h
+
+#include "vtkSMPTools.h"
+#include "vtkType.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+class vtkLIC3DRadixSort
+{
+public:
+	/**
+	* Map a float to an unsigned key, with the same order than the floats.
+	*/
+	static unsigned int FloatToKey(float value)
+	{
+		unsigned int bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		// Negative values have their order reversed, positive ones come after
+		return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+	}
+
+	/**
+	* Sort the n first keys, moving the values along. The arrays must hold at
+	* least n elements.
+	*/
+	template <typename ValueType>
+	void Sort(vtkIdType n, unsigned int* keys, ValueType* values)
+	{
+		if (n < 2)
+		{
+			return;
+		}
+		this->KeysBuffer.resize(n);
+		this->ValuesBuffer.resize(n * sizeof(ValueType));
+		unsigned int* keysIn = keys;
+		ValueType* valuesIn = values;
+		unsigned int* keysOut = &this->KeysBuffer[0];
+		ValueType* valuesOut = reinterpret_cast<ValueType*>(&this->ValuesBuffer[0]);
+
+		const vtkIdType chunkSize = std::max<vtkIdType>(SerialSize, (n + NbChunks - 1) / NbChunks);
+		const int nbChunks = static_cast<int>((n + chunkSize - 1) / chunkSize);
+		this->Histograms.resize(nbChunks * NbBuckets);
+
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			// Count the digits of each chunk
+			std::fill(this->Histograms.begin(), this->Histograms.end(), 0);
+			HistogramFunctor histogram = { keysIn, n, chunkSize, shift, &this->Histograms[0] };
+			vtkSMPTools::For(0, nbChunks, histogram);
+
+			// Turn the counts into the output offset of each digit of each chunk
+			vtkIdType offset = 0;
+			for (int bucket = 0; bucket < NbBuckets; bucket++)
+			{
+				for (int chunk = 0; chunk < nbChunks; chunk++)
+				{
+					vtkIdType& count = this->Histograms[chunk * NbBuckets + bucket];
+					const vtkIdType chunkCount = count;
+					count = offset;
+					offset += chunkCount;
+				}
+			}
+
+			ScatterFunctor<ValueType> scatter = { keysIn, valuesIn, keysOut, valuesOut, n, chunkSize,
+				shift, &this->Histograms[0] };
+			vtkSMPTools::For(0, nbChunks, scatter);
+
+			std::swap(keysIn, keysOut);
+			std::swap(valuesIn, valuesOut);
+		}
+		// An even number of passes leaves the result in the input arrays
+	}
+
+private:
+	enum
+	{
+		NbBuckets = 256,
+		NbChunks = 64,
+		SerialSize = 4096
+	};
+
+	struct HistogramFunctor
+	{
+		const unsigned int* Keys;
+		vtkIdType Size;
+		vtkIdType ChunkSize;
+		int Shift;
+		vtkIdType* Histograms;
+
+		void operator()(vtkIdType begin, vtkIdType end) const
+		{
+			for (vtkIdType chunk = begin; chunk < end; chunk++)
+			{
+				vtkIdType* histogram = this->Histograms + chunk * NbBuckets;
+				const vtkIdType last = std::min(this->Size, (chunk + 1) * this->ChunkSize);
+				for (vtkIdType i = chunk * this->ChunkSize; i < last; i++)
+				{
+					histogram[(this->Keys[i] >> this->Shift) & 0xFF]++;
+				}
+			}
+		}
+	};
+
+	template <typename ValueType>
+	struct ScatterFunctor
+	{
+		const unsigned int* KeysIn;
+		const ValueType* ValuesIn;
+		unsigned int* KeysOut;
+		ValueType* ValuesOut;
+		vtkIdType Size;
+		vtkIdType ChunkSize;
+		int Shift;
+		vtkIdType* Offsets;
+
+		void operator()(vtkIdType begin, vtkIdType end) const
+		{
+			for (vtkIdType chunk = begin; chunk < end; chunk++)
+			{
+				vtkIdType* offsets = this->Offsets + chunk * NbBuckets;
+				const vtkIdType last = std::min(this->Size, (chunk + 1) * this->ChunkSize);
+				for (vtkIdType i = chunk * this->ChunkSize; i < last; i++)
+				{
+					const vtkIdType dest = offsets[(this->KeysIn[i] >> this->Shift) & 0xFF]++;
+					this->KeysOut[dest] = this->KeysIn[i];
+					this->ValuesOut[dest] = this->ValuesIn[i];
+				}
+			}
+		}
+	};
+
+	std::vector<unsigned int> KeysBuffer;
+	std::vector<char> ValuesBuffer;
+	std::vector<vtkIdType> Histograms;
+};
+
+#endif
@@ -1,16 +1,23 @@
 #include "vtkLIC3DRepresentation.h"
 
 #include "vtkAlgorithmOutput.h"
+#include "vtkCamera.h"
 #include "vtkCellData.h"
 #include "vtkColorTransferFunction.h"
 #include "vtkCommand.h"
+#include "vtkCompositeDataIterator.h"
+#include "vtkCompositeDataSet.h"
 #include "vtkCompositeDataToUnstructuredGridFilter.h"
+#include "vtkDoubleArray.h"
+#include "vtkDataSetTriangleFilter.h"
 #include "vtkExtentTranslator.h"
+#include "vtkFieldData.h"
+#include "vtkFixedPointVolumeRayCastMapper.h"
 #include "vtkImageData.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkMath.h"
-#include "vtkMultiBlockDataSet.h"
+#include "vtkMatrix4x4.h"
 #include "vtkNew.h"
 #include "vtkObjectFactory.h"
 #include "vtkPExtentTranslator.h"
@@ -21,15 +28,23 @@
 #include "vtkProperty.h"
 #include "vtkRenderer.h"
 #include "vtkSmartPointer.h"
+#include "vtkLIC3DCellDepthSort.h"
 #include "vtkLIC3DMapper.h"
+#include "vtkLIC3DProductCache.h"
+#include "vtkLIC3DVolumeFilter.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 #include "vtkStructuredData.h"
 #include "vtkTransform.h"
 #include "vtkUnsignedCharArray.h"
 #include "vtkProjectedTetrahedraMapper.h"
+#include "vtkSmartVolumeMapper.h"
 #include "vtkVolume.h"
+#include "vtkVolumeMapper.h"
 #include "vtkPVLODVolume.h"
 #include "vtkVolumeProperty.h"
+#include "vtkUnstructuredGrid.h"
+#include "vtkUnstructuredGridVolumeRayCastMapper.h"
+#include "vtkUnstructuredGridVolumeZSweepMapper.h"
 #include "vtkResampleToImage.h"
 #include "vtkPiecewiseFunction.h"
 
@@ -39,8 +54,80 @@
 
 namespace
 {
+	// Number of cells up to which the automatic volume mapper selection uses
+	// the Bunyk ray caster, then the projected tetrahedra
+	const vtkIdType vtkBunykMaximumNumberOfCells = 100000;
+	const vtkIdType vtkProjectedTetrahedraMaximumNumberOfCells = 10000000;
+
+	//----------------------------------------------------------------------------
+	vtkIdType vtkCountCells(vtkDataObject* data)
+	{
+		vtkDataSet* dataSet = vtkDataSet::SafeDownCast(data);
+		if (dataSet)
+		{
+			return dataSet->GetNumberOfCells();
+		}
+		vtkIdType nbCells = 0;
+		vtkCompositeDataSet* composite = vtkCompositeDataSet::SafeDownCast(data);
+		if (composite)
+		{
+			vtkSmartPointer<vtkCompositeDataIterator> iter;
+			iter.TakeReference(composite->NewIterator());
+			for (iter->InitTraversal(); !iter->IsDoneWithTraversal(); iter->GoToNextItem())
+			{
+				nbCells += vtkCountCells(iter->GetCurrentDataObject());
+			}
+		}
+		return nbCells;
+	}
+
+	//----------------------------------------------------------------------------
+	bool vtkIsGhostCell(vtkUnsignedCharArray* ghostArray, int* pntExtent, int i, int j, int k)
+	{
+		int ijk[3] = { i, j, k };
+		vtkIdType cellId = vtkStructuredData::ComputeCellIdForExtent(pntExtent, ijk);
+		return (ghostArray->GetValue(cellId) & vtkDataSetAttributes::DUPLICATECELL) != 0;
+	}
+
+	//----------------------------------------------------------------------------
+	// Check that the given cell extent is exactly the non ghost part of the
+	// data: its corners are not ghost cells while the cells right outside are.
+	bool vtkIsNonGhostCellExtent(vtkUnsignedCharArray* ghostArray, int* pntExtent,
+		const int* dataCellExtent, const int* cellExtent)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			if (cellExtent[2 * a] < dataCellExtent[2 * a] ||
+				cellExtent[2 * a + 1] > dataCellExtent[2 * a + 1] ||
+				cellExtent[2 * a] > cellExtent[2 * a + 1])
+			{
+				return false;
+			}
+		}
+		if (vtkIsGhostCell(ghostArray, pntExtent, cellExtent[0], cellExtent[2], cellExtent[4]) ||
+			vtkIsGhostCell(ghostArray, pntExtent, cellExtent[1], cellExtent[3], cellExtent[5]))
+		{
+			return false;
+		}
+		for (int a = 0; a < 3; a++)
+		{
+			int lower[3] = { cellExtent[0], cellExtent[2], cellExtent[4] };
+			int upper[3] = { cellExtent[1], cellExtent[3], cellExtent[5] };
+			lower[a]--;
+			upper[a]++;
+			if ((lower[a] >= dataCellExtent[2 * a] &&
+					!vtkIsGhostCell(ghostArray, pntExtent, lower[0], lower[1], lower[2])) ||
+				(upper[a] <= dataCellExtent[2 * a + 1] &&
+					!vtkIsGhostCell(ghostArray, pntExtent, upper[0], upper[1], upper[2])))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
 	//----------------------------------------------------------------------------
-	void vtkGetNonGhostExtent(int* resultExtent, vtkImageData* dataSet)
+	void vtkGetNonGhostExtent(int* resultExtent, vtkImageData* dataSet, vtkInformation* inInfo)
 	{
 		// this is really only meant for topologically structured grids
 		dataSet->GetExtent(resultExtent);
@@ -48,41 +135,101 @@ namespace
 		if (vtkUnsignedCharArray* ghostArray = vtkUnsignedCharArray::SafeDownCast(
 			dataSet->GetCellData()->GetArray(vtkDataSetAttributes::GhostArrayName())))
 		{
-			// We have a ghost array. We need to iterate over the array to prune ghost
-			// extents.
+			// We have a ghost array. The non ghost cells are a box inside the
+			// data extent that we find without going through the whole array.
 
 			int pntExtent[6];
 			std::copy(resultExtent, resultExtent + 6, pntExtent);
 
+			int dataCellExtent[6];
+			vtkStructuredData::GetCellExtentFromPointExtent(pntExtent, dataCellExtent);
+			if (pntExtent[0] == pntExtent[1] || pntExtent[2] == pntExtent[3] ||
+				pntExtent[4] == pntExtent[5])
+			{
+				// Ghost levels are only handled for 3D images
+				return;
+			}
+
 			int validCellExtent[6];
-			vtkStructuredData::GetCellExtentFromPointExtent(pntExtent, validCellExtent);
+			bool found = false;
 
-			// The start extent is the location of the first cell with ghost value 0.
-			vtkIdType numTuples = ghostArray->GetNumberOfTuples();
-			for (vtkIdType cc = 0; cc < numTuples; ++cc)
+			// First, the extent of the piece without ghost levels as requested
+			// by the pipeline, if the producer followed the default partitioning.
+			if (inInfo && inInfo->Has(vtkStreamingDemandDrivenPipeline::UPDATE_PIECE_NUMBER()) &&
+				inInfo->Has(vtkStreamingDemandDrivenPipeline::UPDATE_NUMBER_OF_PIECES()) &&
+				inInfo->Has(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT()))
 			{
-				if (ghostArray->GetValue(cc) == 0)
+				int wholeExtent[6];
+				int pieceExtent[6];
+				inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), wholeExtent);
+				vtkNew<vtkExtentTranslator> translator;
+				translator->PieceToExtentThreadSafe(
+					inInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_PIECE_NUMBER()),
+					inInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_NUMBER_OF_PIECES()), 0,
+					wholeExtent, pieceExtent, vtkExtentTranslator::BLOCK_MODE, 0);
+				vtkStructuredData::GetCellExtentFromPointExtent(pieceExtent, validCellExtent);
+				found = vtkIsNonGhostCellExtent(ghostArray, pntExtent, dataCellExtent, validCellExtent);
+			}
+
+			// Otherwise, walk along the axes going through the center cell.
+			int center[3] = { (dataCellExtent[0] + dataCellExtent[1]) / 2,
+				(dataCellExtent[2] + dataCellExtent[3]) / 2, (dataCellExtent[4] + dataCellExtent[5]) / 2 };
+			if (!found && !vtkIsGhostCell(ghostArray, pntExtent, center[0], center[1], center[2]))
+			{
+				for (int a = 0; a < 3; a++)
 				{
-					int ijk[3];
-					vtkStructuredData::ComputeCellStructuredCoordsForExtent(cc, pntExtent, ijk);
-					validCellExtent[0] = ijk[0];
-					validCellExtent[2] = ijk[1];
-					validCellExtent[4] = ijk[2];
-					break;
+					int ijk[3] = { center[0], center[1], center[2] };
+					while (ijk[a] > dataCellExtent[2 * a] &&
+						!vtkIsGhostCell(ghostArray, pntExtent, ijk[0] - (a == 0), ijk[1] - (a == 1),
+							ijk[2] - (a == 2)))
+					{
+						ijk[a]--;
+					}
+					validCellExtent[2 * a] = ijk[a];
+					ijk[a] = center[a];
+					while (ijk[a] < dataCellExtent[2 * a + 1] &&
+						!vtkIsGhostCell(ghostArray, pntExtent, ijk[0] + (a == 0), ijk[1] + (a == 1),
+							ijk[2] + (a == 2)))
+					{
+						ijk[a]++;
+					}
+					validCellExtent[2 * a + 1] = ijk[a];
 				}
+				found = vtkIsNonGhostCellExtent(ghostArray, pntExtent, dataCellExtent, validCellExtent);
 			}
 
-			// The end extent is the  location of the last cell with ghost value 0.
-			for (vtkIdType cc = (numTuples - 1); cc >= 0; --cc)
+			if (!found)
 			{
-				if (ghostArray->GetValue(cc) == 0)
+				// Unusual ghost layout: iterate over the array to prune ghost extents.
+				std::copy(dataCellExtent, dataCellExtent + 6, validCellExtent);
+
+				// The start extent is the location of the first cell with ghost value 0.
+				vtkIdType numTuples = ghostArray->GetNumberOfTuples();
+				for (vtkIdType cc = 0; cc < numTuples; ++cc)
+				{
+					if (ghostArray->GetValue(cc) == 0)
+					{
+						int ijk[3];
+						vtkStructuredData::ComputeCellStructuredCoordsForExtent(cc, pntExtent, ijk);
+						validCellExtent[0] = ijk[0];
+						validCellExtent[2] = ijk[1];
+						validCellExtent[4] = ijk[2];
+						break;
+					}
+				}
+
+				// The end extent is the  location of the last cell with ghost value 0.
+				for (vtkIdType cc = (numTuples - 1); cc >= 0; --cc)
 				{
-					int ijk[3];
-					vtkStructuredData::ComputeCellStructuredCoordsForExtent(cc, pntExtent, ijk);
-					validCellExtent[1] = ijk[0];
-					validCellExtent[3] = ijk[1];
-					validCellExtent[5] = ijk[2];
-					break;
+					if (ghostArray->GetValue(cc) == 0)
+					{
+						int ijk[3];
+						vtkStructuredData::ComputeCellStructuredCoordsForExtent(cc, pntExtent, ijk);
+						validCellExtent[1] = ijk[0];
+						validCellExtent[3] = ijk[1];
+						validCellExtent[5] = ijk[2];
+						break;
+					}
 				}
 			}
 
@@ -109,13 +256,40 @@ vtkLIC3DRepresentation::vtkLIC3DRepresentation()
 	//this->Actor->SetProperty(this->Property);
 	//this->Actor->SetEnableLOD(0);
 
+	// Coarse image rendered during interaction
 	this->ResampleToImageFilter = vtkResampleToImage::New();
-	this->ResampleToImageFilter->SetSamplingDimensions(128, 128, 128);
-
-	this->RayCastMapper = vtkProjectedTetrahedraMapper::New();
+	this->ResampleToImageFilter->SetSamplingDimensions(64, 64, 64);
+	this->LODMapper = vtkSmartVolumeMapper::New();
+
+	this->LICResampleFilter = vtkResampleToImage::New();
+	this->LICResampleFilter->SetSamplingDimensions(128, 128, 128);
+	this->LICFilter = vtkLIC3DVolumeFilter::New();
+	this->UseLIC = true;
+	this->LICOpacityMask = true;
+	this->LICProgressive = true;
+	this->LICRefinementTimeBudget = 0.1;
+	this->LICActive = false;
+	this->LICFromCache = false;
+	vtkMath::UninitializeBounds(this->LICActiveBounds);
+
+	this->ProductCache = vtkLIC3DProductCache::New();
+	this->CachedProductsValid = false;
+
+	this->Tetrahedralizer = vtkDataSetTriangleFilter::New();
+	this->Tetrahedralizer->TetrahedraOnlyOn();
+	this->ProjectedTetrahedraMapper = vtkProjectedTetrahedraMapper::New();
+	this->ProjectedTetrahedraMapper->SetVisibilitySort(this->CellDepthSort.GetPointer());
+	this->TetrahedraInput = 0;
+	this->ZSweepMapper = vtkUnstructuredGridVolumeZSweepMapper::New();
+	this->BunykMapper = vtkUnstructuredGridVolumeRayCastMapper::New();
+	this->SmartMapper = vtkSmartVolumeMapper::New();
+	this->FixedPointMapper = vtkFixedPointVolumeRayCastMapper::New();
+	this->ActiveMapper = this->ProjectedTetrahedraMapper;
+	this->VolumeMapperType = AUTOMATIC_MAPPER;
 	this->Volume = vtkPVLODVolume::New();
 	this->VolProperty = vtkVolumeProperty::New();
 	this->Volume->SetProperty(this->VolProperty);
+	this->Volume->SetLODMapper(this->LODMapper);
 	this->Volume->SetEnableLOD(0);
 
 	this->CacheKeeper = vtkPVCacheKeeper::New();
@@ -128,6 +302,9 @@ vtkLIC3DRepresentation::vtkLIC3DRepresentation()
 
 	vtkMath::UninitializeBounds(this->DataBounds);
 	this->DataSize = 0;
+	this->RequestDataCount = 0;
+	this->UseCropping = false;
+	vtkMath::UninitializeBounds(this->CroppingBounds);
 
 	this->Origin[0] = this->Origin[1] = this->Origin[2] = 0;
 	this->Spacing[0] = this->Spacing[1] = this->Spacing[2] = 0;
@@ -146,7 +323,16 @@ vtkLIC3DRepresentation::~vtkLIC3DRepresentation()
 	this->MBMerger->Delete();
 
 	this->ResampleToImageFilter->Delete();
-	this->RayCastMapper->Delete();
+	this->LODMapper->Delete();
+	this->LICResampleFilter->Delete();
+	this->LICFilter->Delete();
+	this->ProductCache->Delete();
+	this->Tetrahedralizer->Delete();
+	this->ProjectedTetrahedraMapper->Delete();
+	this->ZSweepMapper->Delete();
+	this->BunykMapper->Delete();
+	this->SmartMapper->Delete();
+	this->FixedPointMapper->Delete();
 	this->VolProperty->Delete();
 	this->Volume->Delete();
 }
@@ -156,6 +342,7 @@ int vtkLIC3DRepresentation::FillInputPortInformation(int, vtkInformation* info)
 	info->Set(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkUnstructuredGridBase");
 	info->Append(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkDataSet");
 	info->Append(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkMultiBlockDataSet");
+	info->Append(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkUniformGridAMR");
 	info->Set(vtkAlgorithm::INPUT_IS_OPTIONAL(), 1);
 	return 1;
 }
@@ -165,7 +352,6 @@ int vtkLIC3DRepresentation::ProcessViewRequest(
 {
 	if (!this->Superclass::ProcessViewRequest(request_type, inInfo, outInfo))
 	{
-		this->MarkModified();
 		return 0;
 	}
 	if (request_type == vtkPVView::REQUEST_UPDATE())
@@ -187,21 +373,67 @@ int vtkLIC3DRepresentation::ProcessViewRequest(
 	}
 	else if (request_type == vtkPVView::REQUEST_UPDATE_LOD())
 	{
+		// Resample the data on a coarse image, cheap to ray cast while the
+		// camera moves.
+		vtkDataObject* lod = this->GetProduct("LOD");
+		if (!lod)
+		{
+			this->ResampleToImageFilter->Update();
+			lod = this->ResampleToImageFilter->GetOutputDataObject(0);
+			// A resampling of a LIC preview is not cached, like the preview
+			if (this->GetNumberOfBricksLeft() == 0)
+			{
+				this->AddProduct("LOD", lod);
+			}
+		}
+		vtkPVRenderView::SetPieceLOD(inInfo, this, lod);
 		vtkPVRenderView::SetRequiresDistributedRenderingLOD(inInfo, this, true);
 	}
 	else if (request_type == vtkPVView::REQUEST_RENDER())
 	{
+		// Use the coarse image for interactive renders only.
+		bool lod = inInfo->Has(vtkPVRenderView::USE_LOD()) == 1;
+
+		if (this->LICActive)
+		{
+			// Follow the edits of the opacity function masking the LIC. They are
+			// made while the user drags the points of the function, so the LIC is
+			// recomputed progressively whatever LICProgressive, the next renders
+			// refining it.
+			vtkPiecewiseFunction* opacity = this->LICFilter->GetOpacityFunction();
+			if (opacity && opacity->GetMTime() > this->LICTime)
+			{
+				vtkDataObject* data =
+					this->UpdateLIC(this->CacheKeeper->GetOutputDataObject(0), true);
+				this->ResampleToImageFilter->SetInputDataObject(data);
+				this->SelectVolumeMapper(data);
+			}
+			if (!lod)
+			{
+				this->RefineLIC(vtkPVRenderView::SafeDownCast(inInfo->Get(vtkPVView::VIEW())));
+			}
+		}
+
+		vtkAlgorithmOutput* producerPortLOD = vtkPVRenderView::GetPieceProducerLOD(inInfo, this);
+		this->LODMapper->SetInputConnection(producerPortLOD);
 		this->UpdateMapperParameters();
-	}
 
-	this->MarkModified();
+		this->Volume->SetEnableLOD(lod ? 1 : 0);
+	}
 
+	// Note: the representation is not marked modified here, it is only
+	// re-executed when its input or parameters change (see MarkModified()).
 	return 1;
 }
 
 int vtkLIC3DRepresentation::RequestData(
 	vtkInformation* request, vtkInformationVector** inputVector, vtkInformationVector* outputVector)
 {
+	this->RequestDataCount++;
+	// Products cached for the cache key are only valid when the data is the
+	// one cached for it as well
+	this->CachedProductsValid = this->GetUsingCacheForUpdate();
+
 	vtkMath::UninitializeBounds(this->DataBounds);
 	this->DataSize = 0;
 	this->Origin[0] = this->Origin[1] = this->Origin[2] = 0;
@@ -218,22 +450,16 @@ int vtkLIC3DRepresentation::RequestData(
 		vtkDataObject* inputDO = vtkDataObject::GetData(inputVector[0], 0);
 		vtkDataSet* inputDS = vtkDataSet::SafeDownCast(inputDO);
 		vtkImageData* inputImage = vtkImageData::SafeDownCast(inputDS);
-		vtkMultiBlockDataSet* inputMB = vtkMultiBlockDataSet::SafeDownCast(inputDO);
+		vtkCompositeDataSet* inputCD = vtkCompositeDataSet::SafeDownCast(inputDO);
 		if (inputImage)
 		{
 			if (!this->GetUsingCacheForUpdate())
 			{
+				// Ghost cells are not cropped out of the data, which would copy every
+				// array: the mappers are restricted to the non ghost extent instead
+				// (see UpdateCropping()).
 				this->Cache->ShallowCopy(inputImage);
-				if (inputImage->HasAnyGhostCells())
-				{
-					int ext[6];
-					vtkGetNonGhostExtent(ext, this->Cache);
-					// Yup, this will modify the "input", but that okay for now. Ultimately,
-					// we will teach the volume mapper to handle ghost cells and this won't
-					// be needed. Once that's done, we'll need to teach the KdTree
-					// generation code to handle overlap in extents, however.
-					this->Cache->Crop(ext);
-				}
+				this->CacheKeeper->SetInputData(this->Cache);
 			}
 			// Collect information about volume that is needed for data redistribution
 			// later.
@@ -250,12 +476,13 @@ int vtkLIC3DRepresentation::RequestData(
 				this->CacheKeeper->SetInputData(inputDS);
 			}
 		}
-		else if (inputMB)
+		else if (inputCD)
 		{
-			vtkCompositeDataToUnstructuredGridFilter::SafeDownCast(this->MBMerger)->SetInputData(inputMB);
+			// Blocks and AMR boxes are kept as they are, the LIC mapper and the
+			// resampling process them natively
 			if (!this->GetUsingCacheForUpdate())
 			{
-				this->CacheKeeper->SetInputConnection(this->MBMerger->GetOutputPort());
+				this->CacheKeeper->SetInputData(inputCD);
 			}
 		}
 		else
@@ -266,24 +493,457 @@ int vtkLIC3DRepresentation::RequestData(
 		}
 
 		this->CacheKeeper->Update();
+		this->UpdateCropping(inputVector[0]->GetInformationObject(0));
 		//this->LICMapper->SetInputConnection(this->CacheKeeper->GetOutputPort());
-		this->RayCastMapper->SetInputConnection(this->CacheKeeper->GetOutputPort());
 
-		vtkDataSet* output = vtkDataSet::SafeDownCast(this->CacheKeeper->GetOutputDataObject(0));
+		vtkDataObject* output = this->CacheKeeper->GetOutputDataObject(0);
 		this->DataSize = output->GetActualMemorySize();
+		output = this->UpdateLIC(output);
+		this->ResampleToImageFilter->SetInputDataObject(output);
+		this->SelectVolumeMapper(output);
 	}
 	else
 	{
 		// when no input is present, it implies that this processes is on a node
 		// without the data input i.e. either client or render-server.
 		//this->LICMapper->RemoveAllInputs();
-		this->RayCastMapper->RemoveAllInputs();
+		this->ProjectedTetrahedraMapper->RemoveAllInputs();
+		this->ZSweepMapper->RemoveAllInputs();
+		this->BunykMapper->RemoveAllInputs();
+		this->SmartMapper->RemoveAllInputs();
+		this->FixedPointMapper->RemoveAllInputs();
+		this->ResampleToImageFilter->RemoveAllInputs();
+		this->LICResampleFilter->RemoveAllInputs();
+		this->LICFilter->RemoveAllInputs();
+		this->Tetrahedra->Initialize();
+		this->TetrahedraInput = 0;
 		this->Volume->SetEnableLOD(1);
 	}
 
 	return this->Superclass::RequestData(request, inputVector, outputVector);
 }
 
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::SelectVolumeMapper(vtkDataObject* data)
+{
+	vtkImageData* image = vtkImageData::SafeDownCast(data);
+	const bool isImage = image && image->GetDataDimension() == 3;
+
+	int type = this->VolumeMapperType;
+	if (type == AUTOMATIC_MAPPER || ((type == SMART_MAPPER || type == FIXED_POINT_MAPPER) && !isImage))
+	{
+		// Ray casting an image is much cheaper than sorting its tetrahedra. For
+		// other meshes, the exact Bunyk ray caster is kept for small ones and
+		// ZSweep, which needs less memory, for large ones.
+		vtkIdType nbCells = vtkCountCells(data);
+		if (isImage)
+		{
+			type = SMART_MAPPER;
+		}
+		else if (nbCells < vtkBunykMaximumNumberOfCells)
+		{
+			type = BUNYK_MAPPER;
+		}
+		else if (nbCells < vtkProjectedTetrahedraMaximumNumberOfCells)
+		{
+			type = PROJECTED_TETRAHEDRA_MAPPER;
+		}
+		else
+		{
+			type = ZSWEEP_MAPPER;
+		}
+	}
+
+	switch (type)
+	{
+	case SMART_MAPPER:
+		this->ActiveMapper = this->SmartMapper;
+		break;
+	case FIXED_POINT_MAPPER:
+		this->ActiveMapper = this->FixedPointMapper;
+		break;
+	case ZSWEEP_MAPPER:
+		this->ActiveMapper = this->ZSweepMapper;
+		break;
+	case BUNYK_MAPPER:
+		this->ActiveMapper = this->BunykMapper;
+		break;
+	case PROJECTED_TETRAHEDRA_MAPPER:
+	default:
+		this->ActiveMapper = this->ProjectedTetrahedraMapper;
+		break;
+	}
+
+	if (this->ActiveMapper->IsA("vtkUnstructuredGridVolumeMapper"))
+	{
+		if (this->UseCropping && image)
+		{
+			// They ignore the cropping planes, the image ghost cells are cropped
+			// out of a copy, made again only when the image changes
+			if (this->CroppedImage->GetNumberOfPoints() == 0 ||
+				data->GetMTime() > this->CroppedImage->GetMTime())
+			{
+				this->CroppedImage->ShallowCopy(data);
+				this->CroppedImage->Crop(this->CroppingExtent);
+			}
+			data = this->CroppedImage.GetPointer();
+		}
+		this->ActiveMapper->SetInputDataObject(this->GetTetrahedra(data));
+	}
+	else
+	{
+		this->CroppedImage->Initialize();
+		this->ActiveMapper->SetInputDataObject(data);
+	}
+	vtkDebugMacro(<< "Volume rendering with " << this->ActiveMapper->GetClassName());
+}
+
+//----------------------------------------------------------------------------
+vtkUnstructuredGrid* vtkLIC3DRepresentation::GetTetrahedra(vtkDataObject* data)
+{
+	// Unstructured mappers only render the tetrahedra of a single grid, use
+	// the data as is when it already is one
+	vtkUnstructuredGrid* grid = vtkUnstructuredGrid::SafeDownCast(data);
+	if (grid && grid->GetNumberOfCells() > 0 && grid->IsHomogeneous() &&
+		grid->GetCellType(0) == VTK_TETRA)
+	{
+		return grid;
+	}
+
+	// The decomposition is only computed again when the data changes, not
+	// when the mapper or the view do
+	if (data != this->TetrahedraInput || data->GetMTime() > this->TetrahedraTime)
+	{
+		vtkUnstructuredGrid* cached = vtkUnstructuredGrid::SafeDownCast(this->GetProduct("Tetrahedra"));
+		if (cached)
+		{
+			return cached;
+		}
+
+		if (data->IsA("vtkCompositeDataSet"))
+		{
+			this->MBMerger->SetInputDataObject(data);
+			this->Tetrahedralizer->SetInputConnection(this->MBMerger->GetOutputPort());
+		}
+		else
+		{
+			this->Tetrahedralizer->SetInputDataObject(data);
+		}
+		this->Tetrahedralizer->Update();
+		this->Tetrahedra->ShallowCopy(this->Tetrahedralizer->GetOutput());
+
+		// Do not keep the intermediate results around
+		this->Tetrahedralizer->RemoveAllInputs();
+		this->MBMerger->RemoveAllInputs();
+		this->Tetrahedralizer->GetOutput()->Initialize();
+		this->TetrahedraInput = data;
+		this->TetrahedraTime.Modified();
+		this->AddProduct("Tetrahedra", this->Tetrahedra.GetPointer());
+	}
+	return this->Tetrahedra.GetPointer();
+}
+
+//----------------------------------------------------------------------------
+vtkDataObject* vtkLIC3DRepresentation::UpdateLIC(vtkDataObject* data, bool progressive)
+{
+	this->LICActive = false;
+	vtkInformation* vectorsInfo = this->GetInputArrayInformation(1);
+	if (!this->UseLIC || !vectorsInfo || !vectorsInfo->Has(vtkDataObject::FIELD_NAME()))
+	{
+		return data;
+	}
+
+	this->LICActive = true;
+	this->LICTime.Modified();
+	vtkDataObject* cached = this->GetProduct("LIC");
+	if (cached)
+	{
+		this->LICFromCache = true;
+		vtkDataArray* bounds = cached->GetFieldData()->GetArray("LICActiveBounds");
+		for (int i = 0; i < 6; i++)
+		{
+			this->LICActiveBounds[i] = bounds ? bounds->GetComponent(i, 0) : 0.;
+		}
+		if (!bounds)
+		{
+			vtkMath::UninitializeBounds(this->LICActiveBounds);
+		}
+		return cached;
+	}
+	this->LICFromCache = false;
+
+	const char* colorArrayName = NULL;
+	int colorAssociation = vtkDataObject::FIELD_ASSOCIATION_POINTS;
+	vtkInformation* colorInfo = this->GetInputArrayInformation(0);
+	if (colorInfo && colorInfo->Has(vtkDataObject::FIELD_NAME()))
+	{
+		colorArrayName = colorInfo->Get(vtkDataObject::FIELD_NAME());
+		colorAssociation = colorInfo->Get(vtkDataObject::FIELD_ASSOCIATION());
+	}
+
+	// The LIC is computed on point data of an image, anything else is resampled
+	vtkImageData* image = vtkImageData::SafeDownCast(data);
+	if (image && vectorsInfo->Get(vtkDataObject::FIELD_ASSOCIATION()) ==
+			vtkDataObject::FIELD_ASSOCIATION_POINTS &&
+		colorAssociation == vtkDataObject::FIELD_ASSOCIATION_POINTS)
+	{
+		this->LICResampleFilter->RemoveAllInputs();
+		this->LICFilter->SetInputDataObject(image);
+	}
+	else
+	{
+		this->LICResampleFilter->SetInputDataObject(data);
+		this->LICFilter->SetInputConnection(this->LICResampleFilter->GetOutputPort());
+	}
+	this->LICFilter->SetProgressive(this->LICProgressive || progressive);
+	this->LICFilter->SetCoarseDimensions(this->ResampleToImageFilter->GetSamplingDimensions());
+	this->LICFilter->SetInputArrayToProcess(
+		0, 0, 0, vtkDataObject::FIELD_ASSOCIATION_POINTS, colorArrayName);
+	this->LICFilter->SetInputArrayToProcess(1, 0, 0, vtkDataObject::FIELD_ASSOCIATION_POINTS,
+		vectorsInfo->Get(vtkDataObject::FIELD_NAME()));
+	this->LICFilter->Update();
+	this->LICFilter->GetActiveBounds(this->LICActiveBounds);
+	if (this->LICFilter->GetNumberOfBricksLeft() == 0)
+	{
+		this->AddLICProduct();
+	}
+
+	return this->LICFilter->GetOutputDataObject(0);
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::AddLICProduct()
+{
+	// The cropping bounds come along
+	vtkNew<vtkDoubleArray> bounds;
+	bounds->SetName("LICActiveBounds");
+	bounds->SetNumberOfTuples(6);
+	for (int i = 0; i < 6; i++)
+	{
+		bounds->SetValue(i, this->LICActiveBounds[i]);
+	}
+	this->AddProduct("LIC", this->LICFilter->GetOutputDataObject(0), bounds.Get());
+}
+
+//----------------------------------------------------------------------------
+vtkMTimeType vtkLIC3DRepresentation::GetProductsTime()
+{
+	vtkMTimeType time = this->ParametersTime.GetMTime();
+	vtkPiecewiseFunction* opacity = this->LICFilter->GetOpacityFunction();
+	return opacity ? std::max(time, opacity->GetMTime()) : time;
+}
+
+//----------------------------------------------------------------------------
+vtkDataObject* vtkLIC3DRepresentation::GetProduct(const char* name)
+{
+	if (!this->GetUseCache() || !this->CachedProductsValid)
+	{
+		return NULL;
+	}
+	return this->ProductCache->GetProduct(name, this->GetCacheKey(), this->GetProductsTime());
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::AddProduct(
+	const char* name, vtkDataObject* data, vtkAbstractArray* fieldArray)
+{
+	if (!this->GetUseCache())
+	{
+		return;
+	}
+	// The filters reuse their outputs, keep a copy. It is complete before
+	// being cached, since the cache may release it at once.
+	vtkSmartPointer<vtkDataObject> copy;
+	copy.TakeReference(data->NewInstance());
+	copy->ShallowCopy(data);
+	if (fieldArray)
+	{
+		copy->GetFieldData()->AddArray(fieldArray);
+	}
+	this->ProductCache->AddProduct(name, this->GetCacheKey(), this->GetProductsTime(), copy);
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::SetProductCacheSize(int size)
+{
+	this->ProductCache->SetMemoryLimit(static_cast<unsigned long>(std::max(size, 0)) * 1024);
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkLIC3DRepresentation::GetNumberOfBricksLeft()
+{
+	// A LIC from the cache is complete
+	return this->LICActive && !this->LICFromCache ? this->LICFilter->GetNumberOfBricksLeft() : 0;
+}
+
+//----------------------------------------------------------------------------
+int vtkLIC3DRepresentation::GetNeedsMoreFrames()
+{
+	return this->GetNumberOfBricksLeft() > 0;
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::MarkParametersModified()
+{
+	this->ParametersTime.Modified();
+	this->MarkModified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::RefineLIC(vtkPVRenderView* view)
+{
+	if (!view || this->GetNumberOfBricksLeft() == 0)
+	{
+		return;
+	}
+
+	// The bricks are prioritized in data coordinates
+	vtkCamera* camera = view->GetActiveCamera();
+	vtkNew<vtkMatrix4x4> inverse;
+	vtkMatrix4x4::Invert(this->Volume->GetMatrix(), inverse.Get());
+	double eye[4];
+	double focalPoint[4];
+	camera->GetPosition(eye);
+	camera->GetFocalPoint(focalPoint);
+	eye[3] = focalPoint[3] = 1.;
+	inverse->MultiplyPoint(eye, eye);
+	inverse->MultiplyPoint(focalPoint, focalPoint);
+	for (int i = 0; i < 3; i++)
+	{
+		eye[i] /= eye[3];
+		focalPoint[i] /= focalPoint[3];
+	}
+
+	// The animation manager keeps rendering the view while GetNeedsMoreFrames()
+	// is true, each render refines the LIC a bit more
+	if (this->LICFilter->Refine(this->LICRefinementTimeBudget, eye, focalPoint) == 0)
+	{
+		this->AddLICProduct();
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::SetUseLIC(bool val)
+{
+	if (this->UseLIC != val)
+	{
+		this->UseLIC = val;
+		this->MarkParametersModified();
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::SetLICKernelLength(double val)
+{
+	this->LICFilter->SetKernelLength(val);
+	this->MarkParametersModified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::SetLICSamplingDimensions(int dx, int dy, int dz)
+{
+	this->LICResampleFilter->SetSamplingDimensions(dx, dy, dz);
+	this->MarkParametersModified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::SetLICOpacityMask(bool val)
+{
+	if (this->LICOpacityMask != val)
+	{
+		this->LICOpacityMask = val;
+		this->LICFilter->SetOpacityFunction(val ? this->VolProperty->GetScalarOpacity() : NULL);
+		this->MarkParametersModified();
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::SetLICProgressive(bool val)
+{
+	if (this->LICProgressive != val)
+	{
+		this->LICProgressive = val;
+		this->MarkParametersModified();
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::SetLICMagnitudeThreshold(double val)
+{
+	this->LICFilter->SetMagnitudeThreshold(val);
+	this->MarkParametersModified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::SetLICNoiseDensity(double val)
+{
+	this->LICFilter->SetNoiseDensity(val);
+	this->MarkParametersModified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::SetVolumeMapperType(int type)
+{
+	if (this->VolumeMapperType != type)
+	{
+		this->VolumeMapperType = type;
+		this->MarkParametersModified();
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::UpdateCropping(vtkInformation* inInfo)
+{
+	this->UseCropping = false;
+	vtkImageData* image = vtkImageData::SafeDownCast(this->CacheKeeper->GetOutputDataObject(0));
+	if (!image || !image->HasAnyGhostCells())
+	{
+		return;
+	}
+
+	int* ext = this->CroppingExtent;
+	vtkGetNonGhostExtent(ext, image, inInfo);
+	double* origin = image->GetOrigin();
+	double* spacing = image->GetSpacing();
+	for (int i = 0; i < 6; i++)
+	{
+		this->CroppingBounds[i] = origin[i / 2] + ext[i] * spacing[i / 2];
+	}
+	this->UseCropping = true;
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::ApplyCropping(vtkAbstractVolumeMapper* mapper)
+{
+	vtkVolumeMapper* volumeMapper = vtkVolumeMapper::SafeDownCast(mapper);
+	if (!volumeMapper)
+	{
+		return;
+	}
+
+	// The blocks skipped by the LIC are empty space, crop them out as well
+	double bounds[6];
+	bool crop = this->UseCropping;
+	std::copy(this->CroppingBounds, this->CroppingBounds + 6, bounds);
+	double* activeBounds = this->LICActiveBounds;
+	if (this->LICActive && vtkMath::AreBoundsInitialized(activeBounds))
+	{
+		for (int i = 0; i < 6; i += 2)
+		{
+			bounds[i] = crop ? std::max(bounds[i], activeBounds[i]) : activeBounds[i];
+			bounds[i + 1] = crop ? std::min(bounds[i + 1], activeBounds[i + 1]) : activeBounds[i + 1];
+		}
+		crop = true;
+	}
+
+	volumeMapper->SetCropping(crop ? 1 : 0);
+	if (crop)
+	{
+		volumeMapper->SetCroppingRegionPlanes(bounds);
+		volumeMapper->SetCroppingRegionFlagsToSubVolume();
+	}
+}
+
 //----------------------------------------------------------------------------
 bool vtkLIC3DRepresentation::IsCached(double cache_key)
 {
@@ -297,6 +957,7 @@ void vtkLIC3DRepresentation::MarkModified()
 	{
 		// Cleanup caches when not using cache.
 		this->CacheKeeper->RemoveAllCaches();
+		this->ProductCache->RemoveAllProducts();
 	}
 	this->Superclass::MarkModified();
 }
@@ -344,35 +1005,57 @@ void vtkLIC3DRepresentation::UpdateMapperParameters()
 		colorArrayName = info->Get(vtkDataObject::FIELD_NAME());
 		fieldAssociation = info->Get(vtkDataObject::FIELD_ASSOCIATION());
 	}
-	this->RayCastMapper->SelectScalarArray(colorArrayName);
+	if (this->LICActive)
+	{
+		// The LIC volume is point data, named after the scalars it modulates
+		colorArrayName = colorArrayName ? colorArrayName : "LIC";
+		fieldAssociation = vtkDataObject::FIELD_ASSOCIATION_POINTS;
+	}
+	this->ActiveMapper->SelectScalarArray(colorArrayName);
+	// The resampled image only has point data
+	this->LODMapper->SelectScalarArray(colorArrayName);
+	this->LODMapper->SetScalarMode(VTK_SCALAR_MODE_USE_POINT_FIELD_DATA);
 
 	switch (fieldAssociation)
 	{
 	case vtkDataObject::FIELD_ASSOCIATION_CELLS:
-		this->RayCastMapper->SetScalarMode(VTK_SCALAR_MODE_USE_CELL_FIELD_DATA);
-		//this->LODMapper->SetScalarMode(VTK_SCALAR_MODE_USE_CELL_FIELD_DATA);
+		this->ActiveMapper->SetScalarMode(VTK_SCALAR_MODE_USE_CELL_FIELD_DATA);
 		break;
 
 	case vtkDataObject::FIELD_ASSOCIATION_NONE:
-		this->RayCastMapper->SetScalarMode(VTK_SCALAR_MODE_USE_FIELD_DATA);
-		//this->LODMapper->SetScalarMode(VTK_SCALAR_MODE_USE_FIELD_DATA);
+		this->ActiveMapper->SetScalarMode(VTK_SCALAR_MODE_USE_FIELD_DATA);
 		break;
 
 	case vtkDataObject::FIELD_ASSOCIATION_POINTS:
 	default:
-		this->RayCastMapper->SetScalarMode(VTK_SCALAR_MODE_USE_POINT_FIELD_DATA);
-		//this->LODMapper->SetScalarMode(VTK_SCALAR_MODE_USE_POINT_FIELD_DATA);
+		this->ActiveMapper->SetScalarMode(VTK_SCALAR_MODE_USE_POINT_FIELD_DATA);
 		break;
 	}
 
-	this->Volume->SetMapper(this->RayCastMapper);
+	this->ApplyCropping(this->ActiveMapper);
+	this->ApplyCropping(this->LODMapper);
+
+	this->Volume->SetMapper(this->ActiveMapper);
 	this->Volume->SetVisibility(1);
 }
 
+//----------------------------------------------------------------------------
+void vtkLIC3DRepresentation::SetInteractiveSamplingDimensions(int dx, int dy, int dz)
+{
+	this->ResampleToImageFilter->SetSamplingDimensions(dx, dy, dz);
+	this->MarkParametersModified();
+}
+
 //----------------------------------------------------------------------------
 void vtkLIC3DRepresentation::PrintSelf(ostream& os, vtkIndent indent)
 {
 	this->Superclass::PrintSelf(os, indent);
+	os << indent << "RequestDataCount: " << this->RequestDataCount << endl;
+	os << indent << "VolumeMapperType: " << this->VolumeMapperType << endl;
+	os << indent << "UseLIC: " << this->UseLIC << endl;
+	os << indent << "LICOpacityMask: " << this->LICOpacityMask << endl;
+	os << indent << "LICProgressive: " << this->LICProgressive << endl;
+	os << indent << "LICRefinementTimeBudget: " << this->LICRefinementTimeBudget << endl;
 }
 
 //***************************************************************************
@@ -394,6 +1077,12 @@ void vtkLIC3DRepresentation::SetColor(vtkColorTransferFunction* lut)
 void vtkLIC3DRepresentation::SetScalarOpacity(vtkPiecewiseFunction* pwf)
 {
 	this->VolProperty->SetScalarOpacity(pwf);
+	if (this->LICOpacityMask && this->LICFilter->GetOpacityFunction() != pwf)
+	{
+		// The LIC depends on the opacity function
+		this->LICFilter->SetOpacityFunction(pwf);
+		this->MarkParametersModified();
+	}
 }
 
 //----------------------------------------------------------------------------
@@ -610,13 +1299,16 @@ void vtkLIC3DRepresentation::SetInputArrayToProcess(
 {
 	this->Superclass::SetInputArrayToProcess(idx, port, connection, fieldAssociation, name);
 
+	// The array selection changed, the representation needs to be updated.
+	this->MarkParametersModified();
+
 	if (idx == 1)
 	{
 		return;
 	}
 
 	//this->LICMapper->SetInputArrayToProcess(idx, port, connection, fieldAssociation, name);
-	this->RayCastMapper->SetInputArrayToProcess(idx, port, connection, fieldAssociation, name);
+	this->ActiveMapper->SetInputArrayToProcess(idx, port, connection, fieldAssociation, name);
 
 	//if (name && name[0])
 	//{
@@ -635,13 +1327,13 @@ void vtkLIC3DRepresentation::SetInputArrayToProcess(
 	{
 	case vtkDataObject::FIELD_ASSOCIATION_CELLS:
 		//this->LICMapper->SetScalarMode(VTK_SCALAR_MODE_USE_CELL_FIELD_DATA);
-		this->RayCastMapper->SetScalarMode(VTK_SCALAR_MODE_USE_CELL_FIELD_DATA);
+		this->ActiveMapper->SetScalarMode(VTK_SCALAR_MODE_USE_CELL_FIELD_DATA);
 		break;
 
 	case vtkDataObject::FIELD_ASSOCIATION_POINTS:
 	default:
 		//this->LICMapper->SetScalarMode(VTK_SCALAR_MODE_USE_POINT_FIELD_DATA);
-		this->RayCastMapper->SetScalarMode(VTK_SCALAR_MODE_USE_POINT_FIELD_DATA);
+		this->ActiveMapper->SetScalarMode(VTK_SCALAR_MODE_USE_POINT_FIELD_DATA);
 		break;
 	}
 }
\ No newline at end of file
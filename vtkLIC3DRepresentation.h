@@ -3,7 +3,10 @@
 
 #include "vtkNew.h"
 #include "vtkPVDataRepresentation.h"
+#include "vtkTimeStamp.h"
 
+class vtkAbstractArray;
+class vtkAbstractVolumeMapper;
 class vtkColorTransferFunction;
 class vtkExtentTranslator;
 class vtkImageData;
@@ -15,13 +18,23 @@ class vtkPolyDataMapper;
 class vtkProperty;
 class vtkPVCacheKeeper;
 class vtkPVLODActor;
+class vtkPVRenderView;
 class vtkVolume;
 class vtkScalarsToColors;
+class vtkLIC3DCellDepthSort;
 class vtkLIC3DMapper;
+class vtkLIC3DProductCache;
+class vtkLIC3DVolumeFilter;
 class vtkProjectedTetrahedraMapper;
 class vtkPVLODVolume;
 class vtkVolumeProperty;
 class vtkResampleToImage;
+class vtkSmartVolumeMapper;
+class vtkDataSetTriangleFilter;
+class vtkFixedPointVolumeRayCastMapper;
+class vtkUnstructuredGrid;
+class vtkUnstructuredGridVolumeRayCastMapper;
+class vtkUnstructuredGridVolumeZSweepMapper;
 
 class VTK_EXPORT vtkLIC3DRepresentation : public vtkPVDataRepresentation
 {
@@ -81,6 +94,121 @@ public:
 	void SetScalarOpacity(vtkPiecewiseFunction* pwf);
 	void SetScalarOpacityUnitDistance(double val);
 
+	/**
+	* Set the dimensions of the coarse image rendered while interacting with
+	* the view (level of detail). Default is 64x64x64.
+	*/
+	void SetInteractiveSamplingDimensions(int, int, int);
+
+	enum VolumeMapperTypes
+	{
+		AUTOMATIC_MAPPER = 0,
+		SMART_MAPPER,
+		FIXED_POINT_MAPPER,
+		ZSWEEP_MAPPER,
+		BUNYK_MAPPER,
+		PROJECTED_TETRAHEDRA_MAPPER
+	};
+
+	//@{
+	/**
+	* Get/Set the volume mapper used to render the data. AUTOMATIC_MAPPER
+	* picks the smart volume mapper for 3D images and, for other datasets
+	* (tetrahedralized first), the Bunyk ray caster, the projected tetrahedra
+	* or the ZSweep mapper as the number of cells grows. SMART_MAPPER and
+	* FIXED_POINT_MAPPER only render 3D images, the automatic choice is used
+	* for other inputs. Default is AUTOMATIC_MAPPER.
+	*/
+	void SetVolumeMapperType(int);
+	vtkGetMacro(VolumeMapperType, int);
+	//@}
+
+	//@{
+	/**
+	* Get/Set whether the volume rendered is the 3D line integral convolution
+	* of the input vectors (input array 1), modulating the colored scalars if
+	* any, instead of the scalars themselves. Default is true.
+	*/
+	void SetUseLIC(bool);
+	vtkGetMacro(UseLIC, bool);
+	//@}
+
+	/**
+	* Set the half length, in voxels, of the LIC convolution kernel.
+	* Default is 10.
+	*/
+	void SetLICKernelLength(double);
+
+	/**
+	* Set the dimensions of the image the input is resampled on to compute
+	* the LIC, when it is not an image with point data arrays.
+	* Default is 128x128x128.
+	*/
+	void SetLICSamplingDimensions(int, int, int);
+
+	//@{
+	/**
+	* Get/Set whether the LIC is only computed in the blocks of voxels made
+	* visible by the scalar opacity function. The volume mappers are cropped to
+	* those blocks as well. Default is true.
+	*/
+	void SetLICOpacityMask(bool);
+	vtkGetMacro(LICOpacityMask, bool);
+	//@}
+
+	/**
+	* Set the vector magnitude, relative to the largest one, below which the
+	* LIC is not computed. Default is 0.
+	*/
+	void SetLICMagnitudeThreshold(double);
+
+	/**
+	* Set the fraction of the voxels seeded by the LIC noise. Sparse noises
+	* make clearer streaks in dense volumes. Default is 1.
+	*/
+	void SetLICNoiseDensity(double);
+
+	//@{
+	/**
+	* Get/Set whether the LIC is computed progressively: a coarse LIC of the
+	* interactive sampling dimensions is rendered first, then each still render
+	* refines bricks of the full resolution LIC, at the center of the view
+	* first, for at most LICRefinementTimeBudget. Default is true.
+	*/
+	void SetLICProgressive(bool);
+	vtkGetMacro(LICProgressive, bool);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the time (in seconds) spent refining the LIC per render.
+	* Default is 0.1.
+	*/
+	vtkSetClampMacro(LICRefinementTimeBudget, double, 0., VTK_DOUBLE_MAX);
+	vtkGetMacro(LICRefinementTimeBudget, double);
+	//@}
+
+	/**
+	* Set the memory (in MiB) used to keep the data derived from cached inputs
+	* (tetrahedralization, LIC volume, interactive image) so that animations
+	* do not compute them again. The least recently used ones are released
+	* first. Default is 1024.
+	*/
+	void SetProductCacheSize(int);
+
+	/**
+	* Returns the number of bricks of a progressive LIC left to refine by the
+	* next still renders, 0 once the LIC is complete.
+	*/
+	vtkIdType GetNumberOfBricksLeft();
+
+	/**
+	* Returns whether the next renders still change the image, in which case
+	* pqLIC3DAnimationManager keeps rendering the view. This is the case while
+	* GetNumberOfBricksLeft() is not 0.
+	*/
+	int GetNeedsMoreFrames();
+
 	//***************************************************************************
 	// Forwarded to vtkStreamLinesMapper
 	//virtual void SetAnimate(bool val);
@@ -112,6 +240,12 @@ public:
 	*/
 	int FillInputPortInformation(int port, vtkInformation* info) VTK_OVERRIDE;
 
+	/**
+	* Number of times the representation has been executed, i.e. of calls
+	* to RequestData(). Rendering passes alone must not increase it.
+	*/
+	vtkGetMacro(RequestDataCount, vtkIdType);
+
 	/**
 	* Provides access to the actor used by this representation.
 	*/
@@ -173,6 +307,66 @@ protected:
 	*/
 	void UpdateMapperParameters();
 
+	/**
+	* Compute the extent of the non ghost cells of image data. Ghost cells
+	* are skipped by the volume mappers through cropping instead of copying
+	* the data into a smaller extent, except for the unstructured mappers
+	* which tetrahedralize a cropped copy.
+	*/
+	void UpdateCropping(vtkInformation* inInfo);
+	void ApplyCropping(vtkAbstractVolumeMapper*);
+
+	/**
+	* Choose the volume mapper from VolumeMapperType and the cached data, and
+	* connect it to the data, tetrahedralized if needed.
+	*/
+	void SelectVolumeMapper(vtkDataObject*);
+
+	/**
+	* Return the data decomposed in tetrahedra for the unstructured mappers.
+	* The decomposition is cached until the data is modified.
+	*/
+	vtkUnstructuredGrid* GetTetrahedra(vtkDataObject*);
+
+	/**
+	* Compute the LIC volume of the data when UseLIC is on and vectors are
+	* selected, and return the data to volume render. The LIC is computed
+	* progressively when LICProgressive or progressive is true.
+	*/
+	vtkDataObject* UpdateLIC(vtkDataObject*, bool progressive = false);
+
+	/**
+	* Refine a progressive LIC for one render of the view.
+	*/
+	void RefineLIC(vtkPVRenderView*);
+
+	/**
+	* Keep the complete LIC volume, with its cropping bounds, in the product
+	* cache.
+	*/
+	void AddLICProduct();
+
+	//@{
+	/**
+	* Get/Add a product derived from the data of the current cache key, when
+	* caching is enabled. AddProduct() gives the cache a shallow copy of the
+	* data, with fieldArray added to its field data when not NULL: the copy may
+	* be released right away when it does not fit in the cache.
+	*/
+	vtkDataObject* GetProduct(const char* name);
+	void AddProduct(const char* name, vtkDataObject*, vtkAbstractArray* fieldArray = NULL);
+	//@}
+
+	/**
+	* Return the last modification time of the parameters of the products.
+	*/
+	vtkMTimeType GetProductsTime();
+
+	/**
+	* Mark the parameters of the products modified, then the representation.
+	*/
+	void MarkParametersModified();
+
 	/**
 	* Used in ConvertSelection to locate the rendered prop.
 	*/
@@ -185,13 +379,48 @@ protected:
 	//vtkProperty* Property;
 	//vtkPVLODActor* Actor;
 
-	vtkProjectedTetrahedraMapper* RayCastMapper;
+	vtkDataSetTriangleFilter* Tetrahedralizer;
+	vtkProjectedTetrahedraMapper* ProjectedTetrahedraMapper;
+	vtkUnstructuredGridVolumeZSweepMapper* ZSweepMapper;
+	vtkUnstructuredGridVolumeRayCastMapper* BunykMapper;
+	vtkSmartVolumeMapper* SmartMapper;
+	vtkFixedPointVolumeRayCastMapper* FixedPointMapper;
+	vtkAbstractVolumeMapper* ActiveMapper;
+	vtkNew<vtkLIC3DCellDepthSort> CellDepthSort;
+	vtkNew<vtkUnstructuredGrid> Tetrahedra;
+	vtkDataObject* TetrahedraInput;
+	vtkTimeStamp TetrahedraTime;
+	vtkSmartVolumeMapper* LODMapper;
 	vtkVolumeProperty* VolProperty;
 	vtkPVLODVolume* Volume;
 
 	vtkResampleToImage* ResampleToImageFilter;
+	vtkResampleToImage* LICResampleFilter;
+	vtkLIC3DVolumeFilter* LICFilter;
+	bool UseLIC;
+	bool LICOpacityMask;
+	bool LICProgressive;
+	double LICRefinementTimeBudget;
+	// Whether the rendered data is the LIC volume, and whether it comes from
+	// the product cache
+	bool LICActive;
+	bool LICFromCache;
+	vtkTimeStamp LICTime;
+	double LICActiveBounds[6];
+
+	vtkLIC3DProductCache* ProductCache;
+	vtkTimeStamp ParametersTime;
+	bool CachedProductsValid;
 
 	unsigned long DataSize;
+	vtkIdType RequestDataCount;
+	int VolumeMapperType;
+	int CroppingExtent[6];
+	double CroppingBounds[6];
+	bool UseCropping;
+	// Image without its ghost cells, for the unstructured mappers which have
+	// no cropping
+	vtkNew<vtkImageData> CroppedImage;
 	double DataBounds[6];
 
 	// meta-data about the input image to pass on to render view for hints
@@ -0,0 +1,988 @@
+#include "vtkLIC3DVolumeFilter.h"
+
+#include "vtkCellData.h"
+#include "vtkDataArray.h"
+#include "vtkFloatArray.h"
+#include "vtkImageData.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkMath.h"
+#include "vtkObjectFactory.h"
+#include "vtkPiecewiseFunction.h"
+#include "vtkPointData.h"
+#include "vtkSMPTools.h"
+#include "vtkTimerLog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	//----------------------------------------------------------------------------
+	// White noise value of a voxel, in [0, 1), non zero for a fraction density
+	// of the voxels only
+	inline float vtkLICNoise(vtkIdType voxel, unsigned int seed, float density)
+	{
+		// Finalizer of MurmurHash3
+		unsigned int h = static_cast<unsigned int>(voxel) ^ (seed * 0x9E3779B9u);
+		h ^= h >> 16;
+		h *= 0x85EBCA6Bu;
+		h ^= h >> 13;
+		h *= 0xC2B2AE35u;
+		h ^= h >> 16;
+		const float value = (h >> 8) * (1.f / 16777216.f);
+		return value < density ? value / density : 0.f;
+	}
+
+	//----------------------------------------------------------------------------
+	// Unit directions of the vectors in index space
+	struct vtkLICDirections
+	{
+		vtkDataArray* Vectors;
+		double Spacing[3];
+		float* Directions;
+
+		void operator()(vtkIdType begin, vtkIdType end) const
+		{
+			for (vtkIdType i = begin; i < end; i++)
+			{
+				double v[3];
+				this->Vectors->GetTuple(i, v);
+				v[0] /= this->Spacing[0];
+				v[1] /= this->Spacing[1];
+				v[2] /= this->Spacing[2];
+				const double norm = vtkMath::Norm(v);
+				const bool valid = norm > 0. && !vtkMath::IsInf(norm) && !vtkMath::IsNan(norm);
+				for (int c = 0; c < 3; c++)
+				{
+					this->Directions[3 * i + c] = valid ? static_cast<float>(v[c] / norm) : 0.f;
+				}
+			}
+		}
+	};
+
+	//----------------------------------------------------------------------------
+	// Flag the blocks holding a visible voxel, and all their voxels
+	struct vtkLICBlockMask
+	{
+		const float* Directions;
+		vtkDataArray* Vectors;
+		double MinimumMagnitude2;
+		// Opacity of the scalars, sampled over their range (NULL when unused)
+		vtkDataArray* Scalars;
+		const double* OpacityTable;
+		int OpacityTableSize;
+		double OpacityTableMin;
+		double OpacityTableScale;
+		double OpacityThreshold;
+		int Dims[3];
+		vtkIdType SliceSize;
+		int BlockSize;
+		int NbBlocks[3];
+		unsigned char* BlockMask;
+		unsigned char* Mask;
+
+		bool IsVisible(vtkIdType voxel) const
+		{
+			const float* d = this->Directions + 3 * voxel;
+			if (d[0] == 0.f && d[1] == 0.f && d[2] == 0.f)
+			{
+				return false;
+			}
+			if (this->MinimumMagnitude2 > 0.)
+			{
+				double v[3];
+				this->Vectors->GetTuple(voxel, v);
+				if (vtkMath::Dot(v, v) < this->MinimumMagnitude2)
+				{
+					return false;
+				}
+			}
+			if (this->Scalars)
+			{
+				const double t =
+					(this->Scalars->GetComponent(voxel, 0) - this->OpacityTableMin) * this->OpacityTableScale;
+				const int i = t > 0. ? std::min(this->OpacityTableSize - 1, static_cast<int>(t + 0.5)) : 0;
+				if (this->OpacityTable[i] <= this->OpacityThreshold)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		void operator()(vtkIdType begin, vtkIdType end) const
+		{
+			for (vtkIdType block = begin; block < end; block++)
+			{
+				int first[3];
+				int last[3];
+				first[0] = static_cast<int>(block % this->NbBlocks[0]) * this->BlockSize;
+				first[1] = static_cast<int>((block / this->NbBlocks[0]) % this->NbBlocks[1]) * this->BlockSize;
+				first[2] = static_cast<int>(block / (this->NbBlocks[0] * this->NbBlocks[1])) * this->BlockSize;
+				for (int a = 0; a < 3; a++)
+				{
+					last[a] = std::min(this->Dims[a], first[a] + this->BlockSize);
+				}
+
+				bool active = false;
+				for (int k = first[2]; k < last[2] && !active; k++)
+				{
+					for (int j = first[1]; j < last[1] && !active; j++)
+					{
+						const vtkIdType row = j * this->Dims[0] + k * this->SliceSize;
+						for (int i = first[0]; i < last[0] && !active; i++)
+						{
+							active = this->IsVisible(row + i);
+						}
+					}
+				}
+
+				this->BlockMask[block] = active ? 1 : 0;
+				for (int k = first[2]; k < last[2]; k++)
+				{
+					for (int j = first[1]; j < last[1]; j++)
+					{
+						const vtkIdType row = j * this->Dims[0] + k * this->SliceSize;
+						std::fill(this->Mask + row + first[0], this->Mask + row + last[0], active ? 1 : 0);
+					}
+				}
+			}
+		}
+	};
+
+	//----------------------------------------------------------------------------
+	// FastLIC over regions of the volume (extents, end excluded), each region
+	// only writes its own voxels
+	struct vtkFastLIC
+	{
+		const float* Directions;
+		int Dims[3];
+		vtkIdType SliceSize;
+		int KernelSamples;
+		int StreamlineSamples;
+		float Step;
+		unsigned int Seed;
+		float Density;
+		const unsigned char* Mask;
+		const int* Regions;
+		const vtkIdType* Order;
+		float* Sums;
+		int* Hits;
+
+		bool Direction(const float p[3], float d[3]) const
+		{
+			int ijk[3];
+			float t[3];
+			for (int a = 0; a < 3; a++)
+			{
+				if (p[a] < 0.f || p[a] > this->Dims[a] - 1)
+				{
+					return false;
+				}
+				ijk[a] = std::min(static_cast<int>(p[a]), std::max(this->Dims[a] - 2, 0));
+				t[a] = p[a] - ijk[a];
+			}
+
+			d[0] = d[1] = d[2] = 0.f;
+			for (int corner = 0; corner < 8; corner++)
+			{
+				const int di = corner & 1;
+				const int dj = (corner >> 1) & 1;
+				const int dk = (corner >> 2) & 1;
+				const float w = (di ? t[0] : 1.f - t[0]) * (dj ? t[1] : 1.f - t[1]) *
+					(dk ? t[2] : 1.f - t[2]);
+				if (w == 0.f)
+				{
+					continue;
+				}
+				const float* dir = this->Directions +
+					3 * (ijk[0] + di + (ijk[1] + dj) * this->Dims[0] + (ijk[2] + dk) * this->SliceSize);
+				d[0] += w * dir[0];
+				d[1] += w * dir[1];
+				d[2] += w * dir[2];
+			}
+
+			const float norm = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+			if (norm < 1e-6f)
+			{
+				return false;
+			}
+			d[0] /= norm;
+			d[1] /= norm;
+			d[2] /= norm;
+			return true;
+		}
+
+		// Voxels crossed by the streamline from a seed (excluded), midpoint rule,
+		// until it leaves the active blocks
+		void Trace(const float seed[3], float step, std::vector<vtkIdType>& voxels) const
+		{
+			voxels.clear();
+			float p[3] = { seed[0], seed[1], seed[2] };
+			const int nbSamples = this->KernelSamples + this->StreamlineSamples;
+			for (int s = 0; s < nbSamples; s++)
+			{
+				float d[3];
+				if (!this->Direction(p, d))
+				{
+					break;
+				}
+				float mid[3] = { p[0] + 0.5f * step * d[0], p[1] + 0.5f * step * d[1],
+					p[2] + 0.5f * step * d[2] };
+				if (!this->Direction(mid, d))
+				{
+					break;
+				}
+				p[0] += step * d[0];
+				p[1] += step * d[1];
+				p[2] += step * d[2];
+				if (p[0] < 0.f || p[0] > this->Dims[0] - 1 || p[1] < 0.f || p[1] > this->Dims[1] - 1 ||
+					p[2] < 0.f || p[2] > this->Dims[2] - 1)
+				{
+					break;
+				}
+				const vtkIdType voxel = static_cast<vtkIdType>(p[0] + 0.5f) +
+					static_cast<vtkIdType>(p[1] + 0.5f) * this->Dims[0] +
+					static_cast<vtkIdType>(p[2] + 0.5f) * this->SliceSize;
+				if (!this->Mask[voxel])
+				{
+					break;
+				}
+				voxels.push_back(voxel);
+			}
+		}
+
+		bool IsInside(vtkIdType voxel, const int* region) const
+		{
+			const int i = static_cast<int>(voxel % this->Dims[0]);
+			const int j = static_cast<int>((voxel / this->Dims[0]) % this->Dims[1]);
+			const int k = static_cast<int>(voxel / this->SliceSize);
+			return i >= region[0] && i < region[1] && j >= region[2] && j < region[3] &&
+				k >= region[4] && k < region[5];
+		}
+
+		void operator()(vtkIdType begin, vtkIdType end) const
+		{
+			std::vector<vtkIdType> forward;
+			std::vector<vtkIdType> backward;
+			std::vector<vtkIdType> samples;
+			std::vector<double> prefix;
+
+			for (vtkIdType r = begin; r < end; r++)
+			{
+				const int* region = this->Regions + 6 * this->Order[r];
+				for (int k = region[4]; k < region[5]; k++)
+				{
+					for (int j = region[2]; j < region[3]; j++)
+					{
+						for (int i = region[0]; i < region[1]; i++)
+						{
+							const vtkIdType seedVoxel = i + j * this->Dims[0] + k * this->SliceSize;
+							if (this->Hits[seedVoxel] > 0 || !this->Mask[seedVoxel])
+							{
+								// Already reached by a streamline, or not visible
+								continue;
+							}
+
+							const float seed[3] = { static_cast<float>(i), static_cast<float>(j),
+								static_cast<float>(k) };
+							this->Trace(seed, -this->Step, backward);
+							this->Trace(seed, this->Step, forward);
+
+							// Samples ordered along the flow, with the noise prefix sums
+							samples.assign(backward.rbegin(), backward.rend());
+							const int center = static_cast<int>(samples.size());
+							samples.push_back(seedVoxel);
+							samples.insert(samples.end(), forward.begin(), forward.end());
+							const int nbSamples = static_cast<int>(samples.size());
+							prefix.resize(nbSamples + 1);
+							prefix[0] = 0.;
+							for (int s = 0; s < nbSamples; s++)
+							{
+								prefix[s + 1] = prefix[s] + vtkLICNoise(samples[s], this->Seed, this->Density);
+							}
+
+							// Every sample around the seed gets its kernel sum from the prefix
+							// sums instead of a new convolution
+							const int lo = std::max(0, center - this->StreamlineSamples);
+							const int hi = std::min(nbSamples - 1, center + this->StreamlineSamples);
+							for (int s = lo; s <= hi; s++)
+							{
+								const vtkIdType voxel = samples[s];
+								if (s != center && !this->IsInside(voxel, region))
+								{
+									continue;
+								}
+								const int a = std::max(0, s - this->KernelSamples);
+								const int b = std::min(nbSamples - 1, s + this->KernelSamples);
+								this->Sums[voxel] +=
+									static_cast<float>((prefix[b + 1] - prefix[a]) / (b - a + 1));
+								this->Hits[voxel]++;
+							}
+						}
+					}
+				}
+			}
+		}
+	};
+
+	//----------------------------------------------------------------------------
+	// Mean and contrast scale of the convolved voxels of some regions, return
+	// the number of those voxels
+	vtkIdType vtkLICStatistics(const float* sums, const int* hits, const int dims[3],
+		const int* regions, const vtkIdType* order, vtkIdType begin, vtkIdType end, double& mean,
+		double& scale)
+	{
+		double sum = 0.;
+		double sum2 = 0.;
+		vtkIdType count = 0;
+		for (vtkIdType r = begin; r < end; r++)
+		{
+			const int* region = regions + 6 * order[r];
+			for (int k = region[4]; k < region[5]; k++)
+			{
+				for (int j = region[2]; j < region[3]; j++)
+				{
+					const vtkIdType row = j * dims[0] + k * static_cast<vtkIdType>(dims[0]) * dims[1];
+					for (int i = region[0]; i < region[1]; i++)
+					{
+						if (hits[row + i] > 0)
+						{
+							const double value = sums[row + i] / hits[row + i];
+							sum += value;
+							sum2 += value * value;
+							count++;
+						}
+					}
+				}
+			}
+		}
+		// The box filtered noise has a small variance around its mean, stretch it
+		mean = count > 0 ? sum / count : 0.;
+		const double variance = count > 0 ? std::max(0., sum2 / count - mean * mean) : 0.;
+		scale = variance > 0. ? 1. / (6. * std::sqrt(variance)) : 1.;
+		return count;
+	}
+
+	//----------------------------------------------------------------------------
+	// Contrast stretched LIC of some regions, modulating the scalars if any
+	struct vtkLICOutput
+	{
+		const float* Sums;
+		const int* Hits;
+		int Dims[3];
+		const int* Regions;
+		const vtkIdType* Order;
+		vtkDataArray* Scalars;
+		double ScalarMin;
+		double Mean;
+		double Scale;
+		float* Output;
+
+		void operator()(vtkIdType begin, vtkIdType end) const
+		{
+			for (vtkIdType r = begin; r < end; r++)
+			{
+				const int* region = this->Regions + 6 * this->Order[r];
+				for (int k = region[4]; k < region[5]; k++)
+				{
+					for (int j = region[2]; j < region[3]; j++)
+					{
+						const vtkIdType row =
+							j * this->Dims[0] + k * static_cast<vtkIdType>(this->Dims[0]) * this->Dims[1];
+						for (vtkIdType v = row + region[0]; v < row + region[1]; v++)
+						{
+							if (this->Hits[v] == 0)
+							{
+								// Skipped voxel, left as is
+								this->Output[v] =
+									this->Scalars ? static_cast<float>(this->Scalars->GetComponent(v, 0)) : 0.f;
+								continue;
+							}
+							double lic = (this->Sums[v] / this->Hits[v] - this->Mean) * this->Scale + 0.5;
+							lic = std::min(1., std::max(0., lic));
+							if (this->Scalars)
+							{
+								const double s = this->Scalars->GetComponent(v, 0);
+								lic = this->ScalarMin + lic * (s - this->ScalarMin);
+							}
+							this->Output[v] = static_cast<float>(lic);
+						}
+					}
+				}
+			}
+		}
+	};
+
+	//----------------------------------------------------------------------------
+	// Directions and mask of a coarse lattice taking one voxel every stride
+	struct vtkLICCoarsen
+	{
+		const float* Directions;
+		const unsigned char* Mask;
+		int Dims[3];
+		int Stride[3];
+		int CoarseDims[3];
+		float* CoarseDirections;
+		unsigned char* CoarseMask;
+
+		void operator()(vtkIdType begin, vtkIdType end) const
+		{
+			for (vtkIdType c = begin; c < end; c++)
+			{
+				const vtkIdType i = (c % this->CoarseDims[0]) * this->Stride[0];
+				const vtkIdType j = ((c / this->CoarseDims[0]) % this->CoarseDims[1]) * this->Stride[1];
+				const vtkIdType k = (c / (this->CoarseDims[0] * this->CoarseDims[1])) * this->Stride[2];
+				const vtkIdType v = i + j * this->Dims[0] + k * this->Dims[0] * this->Dims[1];
+				// Index space directions are shrunk by the stride
+				float d[3];
+				float norm = 0.f;
+				for (int a = 0; a < 3; a++)
+				{
+					d[a] = this->Directions[3 * v + a] / this->Stride[a];
+					norm += d[a] * d[a];
+				}
+				norm = std::sqrt(norm);
+				for (int a = 0; a < 3; a++)
+				{
+					this->CoarseDirections[3 * c + a] = norm > 0.f ? d[a] / norm : 0.f;
+				}
+				this->CoarseMask[c] = this->Mask[v];
+			}
+		}
+	};
+
+	//----------------------------------------------------------------------------
+	// Full resolution preview of a coarse LIC, nearest coarse voxel
+	struct vtkLICPreview
+	{
+		const float* CoarseLIC;
+		const unsigned char* Mask;
+		int Dims[3];
+		int Stride[3];
+		int CoarseDims[3];
+		vtkDataArray* Scalars;
+		double ScalarMin;
+		float* Output;
+
+		void operator()(vtkIdType begin, vtkIdType end) const
+		{
+			for (vtkIdType v = begin; v < end; v++)
+			{
+				const double s = this->Scalars ? this->Scalars->GetComponent(v, 0) : 0.;
+				if (!this->Mask[v])
+				{
+					this->Output[v] = static_cast<float>(s);
+					continue;
+				}
+				const vtkIdType i = (v % this->Dims[0]) / this->Stride[0];
+				const vtkIdType j = ((v / this->Dims[0]) % this->Dims[1]) / this->Stride[1];
+				const vtkIdType k = (v / (static_cast<vtkIdType>(this->Dims[0]) * this->Dims[1])) /
+					this->Stride[2];
+				const double lic = this->CoarseLIC[i + j * this->CoarseDims[0] +
+					k * this->CoarseDims[0] * this->CoarseDims[1]];
+				this->Output[v] =
+					static_cast<float>(this->Scalars ? this->ScalarMin + lic * (s - this->ScalarMin) : lic);
+			}
+		}
+	};
+
+	//----------------------------------------------------------------------------
+	// Split an extent in regions of at most size voxels along each axis
+	void vtkLICSplit(const int dims[3], const int size[3], std::vector<int>& regions)
+	{
+		regions.clear();
+		for (int k = 0; k < dims[2]; k += size[2])
+		{
+			for (int j = 0; j < dims[1]; j += size[1])
+			{
+				for (int i = 0; i < dims[0]; i += size[0])
+				{
+					const int region[6] = { i, std::min(dims[0], i + size[0]), j,
+						std::min(dims[1], j + size[1]), k, std::min(dims[2], k + size[2]) };
+					regions.insert(regions.end(), region, region + 6);
+				}
+			}
+		}
+	}
+
+	//----------------------------------------------------------------------------
+	// Slabs along Z, enough to balance the threads, thick enough for the
+	// streamlines to stay in their slab for a while
+	void vtkLICSlabs(const int dims[3], std::vector<int>& regions)
+	{
+		const int nbSlabs = std::max(1, std::min(64, dims[2] / 4));
+		const int size[3] = { dims[0], dims[1], (dims[2] + nbSlabs - 1) / nbSlabs };
+		vtkLICSplit(dims, size, regions);
+	}
+
+	//----------------------------------------------------------------------------
+	// Regions in their order of creation
+	void vtkLICIdentityOrder(const std::vector<int>& regions, std::vector<vtkIdType>& order)
+	{
+		order.resize(regions.size() / 6);
+		for (size_t r = 0; r < order.size(); r++)
+		{
+			order[r] = static_cast<vtkIdType>(r);
+		}
+	}
+
+	// Edge length, in voxels, of the bricks refined by a progressive LIC, and
+	// number of bricks convolved together
+	const int vtkLICBrickSize = 32;
+	const int vtkLICBrickBatch = 32;
+}
+
+vtkStandardNewMacro(vtkLIC3DVolumeFilter);
+
+//----------------------------------------------------------------------------
+vtkLIC3DVolumeFilter::vtkLIC3DVolumeFilter()
+{
+	this->KernelLength = 10.;
+	this->StreamlineLength = 50.;
+	this->StepSize = 0.5;
+	this->NoiseSeed = 1;
+	this->NoiseDensity = 1.;
+	this->OpacityFunction = NULL;
+	this->OpacityThreshold = 0.;
+	this->MagnitudeThreshold = 0.;
+	this->BlockSize = 8;
+	vtkMath::UninitializeBounds(this->ActiveBounds);
+	this->Progressive = false;
+	this->CoarseDimensions[0] = this->CoarseDimensions[1] = this->CoarseDimensions[2] = 64;
+	this->Dims[0] = this->Dims[1] = this->Dims[2] = 0;
+	this->RegionOrigin[0] = this->RegionOrigin[1] = this->RegionOrigin[2] = 0.;
+	this->Spacing[0] = this->Spacing[1] = this->Spacing[2] = 1.;
+	this->NextRegion = 0;
+	this->HasStatistics = false;
+	this->Mean = 0.;
+	this->Scale = 1.;
+	this->ScalarMin = 0.;
+
+	this->SetInputArrayToProcess(
+		0, 0, 0, vtkDataObject::FIELD_ASSOCIATION_POINTS, vtkDataSetAttributes::SCALARS);
+	this->SetInputArrayToProcess(
+		1, 0, 0, vtkDataObject::FIELD_ASSOCIATION_POINTS, vtkDataSetAttributes::VECTORS);
+}
+
+//----------------------------------------------------------------------------
+vtkLIC3DVolumeFilter::~vtkLIC3DVolumeFilter()
+{
+	this->SetOpacityFunction(NULL);
+}
+
+//----------------------------------------------------------------------------
+vtkCxxSetObjectMacro(vtkLIC3DVolumeFilter, OpacityFunction, vtkPiecewiseFunction);
+
+//----------------------------------------------------------------------------
+vtkMTimeType vtkLIC3DVolumeFilter::GetMTime()
+{
+	vtkMTimeType mTime = this->Superclass::GetMTime();
+	if (this->OpacityFunction)
+	{
+		mTime = std::max(mTime, this->OpacityFunction->GetMTime());
+	}
+	return mTime;
+}
+
+//----------------------------------------------------------------------------
+int vtkLIC3DVolumeFilter::FillInputPortInformation(int vtkNotUsed(port), vtkInformation* info)
+{
+	info->Set(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkImageData");
+	return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkLIC3DVolumeFilter::RequestData(vtkInformation* vtkNotUsed(request),
+	vtkInformationVector** inputVector, vtkInformationVector* outputVector)
+{
+	vtkImageData* input = vtkImageData::GetData(inputVector[0]);
+	vtkImageData* output = vtkImageData::GetData(outputVector);
+	output->CopyStructure(input);
+	output->GetCellData()->PassData(input->GetCellData());
+	vtkMath::UninitializeBounds(this->ActiveBounds);
+	this->ReleaseConvolution();
+
+	const vtkIdType nbPoints = input->GetNumberOfPoints();
+	if (nbPoints == 0)
+	{
+		return 1;
+	}
+
+	int association;
+	vtkDataArray* vectors = this->GetInputArrayToProcess(1, inputVector, association);
+	if (!vectors || vectors->GetNumberOfComponents() != 3 ||
+		association != vtkDataObject::FIELD_ASSOCIATION_POINTS)
+	{
+		vtkErrorMacro(<< "A point data vector array is required.");
+		return 0;
+	}
+	vtkDataArray* scalars = this->GetInputArrayToProcess(0, inputVector, association);
+	if (scalars && (scalars->GetNumberOfComponents() != 1 ||
+		association != vtkDataObject::FIELD_ASSOCIATION_POINTS))
+	{
+		vtkWarningMacro(<< "Only one component point data scalars are modulated by the LIC.");
+		scalars = 0;
+	}
+
+	input->GetDimensions(this->Dims);
+	const double* origin = input->GetOrigin();
+	const int* extent = input->GetExtent();
+	input->GetSpacing(this->Spacing);
+	for (int a = 0; a < 3; a++)
+	{
+		this->RegionOrigin[a] = origin[a] + extent[2 * a] * this->Spacing[a];
+	}
+
+	vtkTimerLog::MarkStartEvent("vtkLIC3DVolumeFilter: directions");
+	this->Directions.resize(3 * nbPoints);
+	vtkLICDirections directionsFunctor;
+	directionsFunctor.Vectors = vectors;
+	input->GetSpacing(directionsFunctor.Spacing);
+	directionsFunctor.Directions = &this->Directions[0];
+	vtkSMPTools::For(0, nbPoints, directionsFunctor);
+	vtkTimerLog::MarkEndEvent("vtkLIC3DVolumeFilter: directions");
+
+	vtkTimerLog::MarkStartEvent("vtkLIC3DVolumeFilter: mask");
+	const vtkIdType nbActive = this->ComputeMask(input, vectors, scalars, &this->Directions[0]);
+	vtkTimerLog::MarkEndEvent("vtkLIC3DVolumeFilter: mask");
+
+	this->Sums.assign(nbPoints, 0.f);
+	this->Hits.assign(nbPoints, 0);
+	this->Scalars = scalars;
+	this->ScalarMin = scalars ? scalars->GetRange(0)[0] : 0.;
+	this->LIC = vtkSmartPointer<vtkFloatArray>::New();
+	this->LIC->SetName(scalars && scalars->GetName() ? scalars->GetName() : "LIC");
+	this->LIC->SetNumberOfTuples(nbPoints);
+	output->GetPointData()->SetScalars(this->LIC);
+
+	const vtkIdType nbCoarse = static_cast<vtkIdType>(this->CoarseDimensions[0]) *
+		this->CoarseDimensions[1] * this->CoarseDimensions[2];
+	if (this->Progressive && nbActive > 0 && nbCoarse < nbPoints)
+	{
+		// Show a coarse LIC right away, the bricks are convolved by Refine()
+		vtkTimerLog::MarkStartEvent("vtkLIC3DVolumeFilter: preview");
+		this->ComputePreview();
+		vtkTimerLog::MarkEndEvent("vtkLIC3DVolumeFilter: preview");
+		const int size[3] = { vtkLICBrickSize, vtkLICBrickSize, vtkLICBrickSize };
+		vtkLICSplit(this->Dims, size, this->Regions);
+		vtkLICIdentityOrder(this->Regions, this->RegionOrder);
+		return 1;
+	}
+
+	vtkLICSlabs(this->Dims, this->Regions);
+	vtkLICIdentityOrder(this->Regions, this->RegionOrder);
+	const vtkIdType nbRegions = static_cast<vtkIdType>(this->RegionOrder.size());
+
+	vtkTimerLog::MarkStartEvent("vtkLIC3DVolumeFilter: convolution");
+	if (nbActive > 0)
+	{
+		this->ConvolveRegions(0, nbRegions);
+	}
+	vtkTimerLog::MarkEndEvent("vtkLIC3DVolumeFilter: convolution");
+
+	vtkTimerLog::MarkStartEvent("vtkLIC3DVolumeFilter: output");
+	vtkLICStatistics(&this->Sums[0], &this->Hits[0], this->Dims, &this->Regions[0],
+		&this->RegionOrder[0], 0, nbRegions, this->Mean, this->Scale);
+	this->OutputRegions(0, nbRegions);
+	vtkTimerLog::MarkEndEvent("vtkLIC3DVolumeFilter: output");
+
+	this->ReleaseConvolution();
+	return 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DVolumeFilter::ConvolveRegions(vtkIdType begin, vtkIdType end)
+{
+	vtkFastLIC lic;
+	lic.Directions = &this->Directions[0];
+	std::copy(this->Dims, this->Dims + 3, lic.Dims);
+	lic.SliceSize = static_cast<vtkIdType>(this->Dims[0]) * this->Dims[1];
+	lic.Step = static_cast<float>(this->StepSize);
+	lic.KernelSamples = std::max(1, vtkMath::Round(this->KernelLength / this->StepSize));
+	lic.StreamlineSamples = vtkMath::Round(this->StreamlineLength / this->StepSize);
+	lic.Seed = static_cast<unsigned int>(this->NoiseSeed);
+	lic.Density = static_cast<float>(this->NoiseDensity);
+	lic.Mask = &this->Mask[0];
+	lic.Regions = &this->Regions[0];
+	lic.Order = &this->RegionOrder[0];
+	lic.Sums = &this->Sums[0];
+	lic.Hits = &this->Hits[0];
+	vtkSMPTools::For(begin, end, 1, lic);
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DVolumeFilter::OutputRegions(vtkIdType begin, vtkIdType end)
+{
+	vtkLICOutput outputFunctor;
+	outputFunctor.Sums = &this->Sums[0];
+	outputFunctor.Hits = &this->Hits[0];
+	std::copy(this->Dims, this->Dims + 3, outputFunctor.Dims);
+	outputFunctor.Regions = &this->Regions[0];
+	outputFunctor.Order = &this->RegionOrder[0];
+	outputFunctor.Scalars = this->Scalars;
+	outputFunctor.ScalarMin = this->ScalarMin;
+	outputFunctor.Mean = this->Mean;
+	outputFunctor.Scale = this->Scale;
+	outputFunctor.Output = this->LIC->GetPointer(0);
+	vtkSMPTools::For(begin, end, 1, outputFunctor);
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DVolumeFilter::ComputePreview()
+{
+	// Coarse lattice of one voxel every stride, with a kernel of the same
+	// length in world coordinates
+	int stride[3];
+	int coarseDims[3];
+	for (int a = 0; a < 3; a++)
+	{
+		const int coarse = std::max(1, this->CoarseDimensions[a]);
+		stride[a] = std::max(1, (this->Dims[a] + coarse - 1) / coarse);
+		coarseDims[a] = (this->Dims[a] + stride[a] - 1) / stride[a];
+	}
+	const vtkIdType nbCoarse = static_cast<vtkIdType>(coarseDims[0]) * coarseDims[1] * coarseDims[2];
+	const int maxStride = std::max(stride[0], std::max(stride[1], stride[2]));
+
+	std::vector<float> directions(3 * nbCoarse);
+	std::vector<unsigned char> mask(nbCoarse);
+	vtkLICCoarsen coarsen;
+	coarsen.Directions = &this->Directions[0];
+	coarsen.Mask = &this->Mask[0];
+	std::copy(this->Dims, this->Dims + 3, coarsen.Dims);
+	std::copy(stride, stride + 3, coarsen.Stride);
+	std::copy(coarseDims, coarseDims + 3, coarsen.CoarseDims);
+	coarsen.CoarseDirections = &directions[0];
+	coarsen.CoarseMask = &mask[0];
+	vtkSMPTools::For(0, nbCoarse, coarsen);
+
+	std::vector<int> regions;
+	std::vector<vtkIdType> order;
+	vtkLICSlabs(coarseDims, regions);
+	vtkLICIdentityOrder(regions, order);
+	const vtkIdType nbRegions = static_cast<vtkIdType>(order.size());
+	std::vector<float> sums(nbCoarse, 0.f);
+	std::vector<int> hits(nbCoarse, 0);
+	vtkFastLIC lic;
+	lic.Directions = &directions[0];
+	std::copy(coarseDims, coarseDims + 3, lic.Dims);
+	lic.SliceSize = static_cast<vtkIdType>(coarseDims[0]) * coarseDims[1];
+	lic.Step = static_cast<float>(this->StepSize);
+	lic.KernelSamples =
+		std::max(1, vtkMath::Round(this->KernelLength / (maxStride * this->StepSize)));
+	lic.StreamlineSamples =
+		vtkMath::Round(this->StreamlineLength / (maxStride * this->StepSize));
+	lic.Seed = static_cast<unsigned int>(this->NoiseSeed);
+	lic.Density = static_cast<float>(this->NoiseDensity);
+	lic.Mask = &mask[0];
+	lic.Regions = &regions[0];
+	lic.Order = &order[0];
+	lic.Sums = &sums[0];
+	lic.Hits = &hits[0];
+	vtkSMPTools::For(0, nbRegions, 1, lic);
+
+	std::vector<float> coarseLIC(nbCoarse);
+	vtkLICOutput outputFunctor;
+	outputFunctor.Sums = &sums[0];
+	outputFunctor.Hits = &hits[0];
+	std::copy(coarseDims, coarseDims + 3, outputFunctor.Dims);
+	outputFunctor.Regions = &regions[0];
+	outputFunctor.Order = &order[0];
+	outputFunctor.Scalars = NULL;
+	outputFunctor.ScalarMin = 0.;
+	vtkLICStatistics(&sums[0], &hits[0], coarseDims, &regions[0], &order[0], 0, nbRegions,
+		outputFunctor.Mean, outputFunctor.Scale);
+	outputFunctor.Output = &coarseLIC[0];
+	vtkSMPTools::For(0, nbRegions, 1, outputFunctor);
+
+	vtkLICPreview preview;
+	preview.CoarseLIC = &coarseLIC[0];
+	preview.Mask = &this->Mask[0];
+	std::copy(this->Dims, this->Dims + 3, preview.Dims);
+	std::copy(stride, stride + 3, preview.Stride);
+	std::copy(coarseDims, coarseDims + 3, preview.CoarseDims);
+	preview.Scalars = this->Scalars;
+	preview.ScalarMin = this->ScalarMin;
+	preview.Output = this->LIC->GetPointer(0);
+	vtkSMPTools::For(0, this->LIC->GetNumberOfTuples(), preview);
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkLIC3DVolumeFilter::Refine(
+	double timeBudget, const double eye[3], const double focalPoint[3])
+{
+	const vtkIdType nbRegions = static_cast<vtkIdType>(this->RegionOrder.size());
+	if (this->NextRegion >= nbRegions)
+	{
+		return 0;
+	}
+
+	vtkTimerLog::MarkStartEvent("vtkLIC3DVolumeFilter: refine");
+	const double endTime = vtkTimerLog::GetUniversalTime() + timeBudget;
+
+	// Bricks the closest to the view axis first
+	double axis[3] = { focalPoint[0] - eye[0], focalPoint[1] - eye[1], focalPoint[2] - eye[2] };
+	vtkMath::Normalize(axis);
+	std::vector<std::pair<double, vtkIdType> > keys;
+	keys.reserve(nbRegions - this->NextRegion);
+	for (vtkIdType r = this->NextRegion; r < nbRegions; r++)
+	{
+		const int* region = &this->Regions[6 * this->RegionOrder[r]];
+		double toCenter[3];
+		for (int a = 0; a < 3; a++)
+		{
+			toCenter[a] = this->RegionOrigin[a] +
+				0.5 * (region[2 * a] + region[2 * a + 1] - 1) * this->Spacing[a] - eye[a];
+		}
+		const double distance = vtkMath::Norm(toCenter);
+		keys.push_back(std::make_pair(
+			distance > 0. ? -vtkMath::Dot(toCenter, axis) / distance : -1., this->RegionOrder[r]));
+	}
+	std::sort(keys.begin(), keys.end());
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		this->RegionOrder[this->NextRegion + i] = keys[i].second;
+	}
+
+	do
+	{
+		const vtkIdType begin = this->NextRegion;
+		const vtkIdType end = std::min(nbRegions, begin + vtkLICBrickBatch);
+		this->ConvolveRegions(begin, end);
+		if (!this->HasStatistics)
+		{
+			// The contrast of the first convolved bricks is kept for the next ones
+			this->HasStatistics = vtkLICStatistics(&this->Sums[0], &this->Hits[0], this->Dims,
+				&this->Regions[0], &this->RegionOrder[0], begin, end, this->Mean, this->Scale) > 0;
+		}
+		this->OutputRegions(begin, end);
+		this->NextRegion = end;
+	} while (this->NextRegion < nbRegions && vtkTimerLog::GetUniversalTime() < endTime);
+
+	this->LIC->Modified();
+	const vtkIdType left = nbRegions - this->NextRegion;
+	if (left == 0)
+	{
+		this->ReleaseConvolution();
+	}
+	vtkTimerLog::MarkEndEvent("vtkLIC3DVolumeFilter: refine");
+	return left;
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DVolumeFilter::ReleaseConvolution()
+{
+	std::vector<float>().swap(this->Directions);
+	std::vector<unsigned char>().swap(this->Mask);
+	std::vector<float>().swap(this->Sums);
+	std::vector<int>().swap(this->Hits);
+	this->Regions.clear();
+	this->RegionOrder.clear();
+	this->NextRegion = 0;
+	this->HasStatistics = false;
+	this->Scalars = NULL;
+	this->LIC = NULL;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkLIC3DVolumeFilter::ComputeMask(
+	vtkImageData* input, vtkDataArray* vectors, vtkDataArray* scalars, const float* directions)
+{
+	vtkLICBlockMask mask;
+	mask.Directions = directions;
+	mask.Vectors = vectors;
+	const double minMagnitude =
+		this->MagnitudeThreshold > 0. ? this->MagnitudeThreshold * vectors->GetRange(-1)[1] : 0.;
+	mask.MinimumMagnitude2 = minMagnitude * minMagnitude;
+
+	// The opacity function is sampled once, it is not meant to be evaluated
+	// from several threads
+	const int tableSize = 1024;
+	std::vector<double> opacities(tableSize);
+	mask.Scalars = this->OpacityFunction ? scalars : NULL;
+	mask.OpacityTable = &opacities[0];
+	mask.OpacityTableSize = tableSize;
+	mask.OpacityTableMin = 0.;
+	mask.OpacityTableScale = 0.;
+	mask.OpacityThreshold = this->OpacityThreshold;
+	if (mask.Scalars)
+	{
+		double range[2];
+		mask.Scalars->GetRange(range, 0);
+		this->OpacityFunction->GetTable(range[0], range[1], tableSize, &opacities[0]);
+		mask.OpacityTableMin = range[0];
+		mask.OpacityTableScale = range[1] > range[0] ? (tableSize - 1) / (range[1] - range[0]) : 0.;
+	}
+
+	input->GetDimensions(mask.Dims);
+	mask.SliceSize = static_cast<vtkIdType>(mask.Dims[0]) * mask.Dims[1];
+	mask.BlockSize = this->BlockSize;
+	for (int a = 0; a < 3; a++)
+	{
+		mask.NbBlocks[a] = (mask.Dims[a] + this->BlockSize - 1) / this->BlockSize;
+	}
+	const vtkIdType nbBlocks =
+		static_cast<vtkIdType>(mask.NbBlocks[0]) * mask.NbBlocks[1] * mask.NbBlocks[2];
+	std::vector<unsigned char> blockMask(nbBlocks);
+	this->Mask.resize(input->GetNumberOfPoints());
+	mask.BlockMask = &blockMask[0];
+	mask.Mask = &this->Mask[0];
+	vtkSMPTools::For(0, nbBlocks, mask);
+
+	// Bounds of the active blocks
+	int ext[6] = { VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN };
+	vtkIdType nbActive = 0;
+	for (vtkIdType block = 0; block < nbBlocks; block++)
+	{
+		if (!blockMask[block])
+		{
+			continue;
+		}
+		const int b[3] = { static_cast<int>(block % mask.NbBlocks[0]),
+			static_cast<int>((block / mask.NbBlocks[0]) % mask.NbBlocks[1]),
+			static_cast<int>(block / (mask.NbBlocks[0] * mask.NbBlocks[1])) };
+		vtkIdType nbVoxels = 1;
+		for (int a = 0; a < 3; a++)
+		{
+			const int first = b[a] * this->BlockSize;
+			const int last = std::min(mask.Dims[a], first + this->BlockSize) - 1;
+			ext[2 * a] = std::min(ext[2 * a], first);
+			ext[2 * a + 1] = std::max(ext[2 * a + 1], last);
+			nbVoxels *= last - first + 1;
+		}
+		nbActive += nbVoxels;
+	}
+
+	if (nbActive > 0)
+	{
+		const double* origin = input->GetOrigin();
+		const double* spacing = input->GetSpacing();
+		const int* extent = input->GetExtent();
+		for (int i = 0; i < 6; i++)
+		{
+			this->ActiveBounds[i] = origin[i / 2] + (extent[2 * (i / 2)] + ext[i]) * spacing[i / 2];
+		}
+	}
+	return nbActive;
+}
+
+//----------------------------------------------------------------------------
+void vtkLIC3DVolumeFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+	this->Superclass::PrintSelf(os, indent);
+	os << indent << "KernelLength: " << this->KernelLength << endl;
+	os << indent << "StreamlineLength: " << this->StreamlineLength << endl;
+	os << indent << "StepSize: " << this->StepSize << endl;
+	os << indent << "NoiseSeed: " << this->NoiseSeed << endl;
+	os << indent << "NoiseDensity: " << this->NoiseDensity << endl;
+	os << indent << "OpacityFunction: " << this->OpacityFunction << endl;
+	os << indent << "OpacityThreshold: " << this->OpacityThreshold << endl;
+	os << indent << "MagnitudeThreshold: " << this->MagnitudeThreshold << endl;
+	os << indent << "BlockSize: " << this->BlockSize << endl;
+	os << indent << "Progressive: " << this->Progressive << endl;
+	os << indent << "CoarseDimensions: " << this->CoarseDimensions[0] << " "
+		 << this->CoarseDimensions[1] << " " << this->CoarseDimensions[2] << endl;
+}
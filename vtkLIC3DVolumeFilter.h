@@ -0,0 +1,258 @@
+/**
+* @class   vtkLIC3DVolumeFilter
+* @brief   compute a 3D line integral convolution volume
+*
+* vtkLIC3DVolumeFilter convolves a white noise volume along the streamlines
+* of the vector field of its input image (input array 1, point data), which
+* produces a scalar volume showing the flow structure once volume rendered.
+*
+* The convolution uses the FastLIC scheme: a streamline is traced from each
+* voxel not reached yet, for much longer than the kernel, and the box kernel
+* sums of all its samples are taken from prefix sums of the noise along it.
+* Every voxel the streamline crosses within StreamlineLength of its seed gets
+* its value, so most voxels never trace their own streamline. The volume is
+* split in slabs along Z processed in parallel with vtkSMPTools, each slab
+* only writing its own voxels. The noise is a hash of the voxel index, there
+* is no noise volume to allocate.
+*
+* When a scalar array is selected (input array 0, point data, one component),
+* the output is that scalar modulated by the LIC, s_min + lic * (s - s_min),
+* under the same name, so the colors and opacities of the scalar still apply.
+* Otherwise the output is the LIC itself, in [0, 1], named "LIC".
+*
+* Only the voxels that will be visible are convolved. The volume is split in
+* blocks of BlockSize^3 voxels, and a block is active when one of its voxels
+* has a vector magnitude of at least MagnitudeThreshold times the largest one
+* and, when an OpacityFunction is set, a scalar of opacity above
+* OpacityThreshold. Streamlines are only seeded in active blocks and stop when
+* they leave them. The other voxels keep their scalar, or 0 without scalars,
+* and ActiveBounds gives the bounds of the active blocks, for instance to crop
+* the volume rendering. A NoiseDensity below 1 uses a sparse noise, which
+* makes fewer but clearer streaks in the volume.
+*
+* In Progressive mode, an execution only convolves a coarse lattice of about
+* CoarseDimensions voxels, copied to the full resolution output so that
+* something can be rendered right away. Refine() then convolves the output by
+* bricks, the ones at the center of the view first, for a given time each
+* call, until the output is complete.
+*
+* Each phase is recorded in vtkTimerLog.
+*/
+
+#ifndef vtkLIC3DVolumeFilter_h
+#define vtkLIC3DVolumeFilter_h
+
+#include "vtkImageAlgorithm.h"
+
+#include "vtkSmartPointer.h" // for vtkSmartPointer
+
+#include <vector> // for std::vector
+
+class vtkDataArray;
+class vtkFloatArray;
+class vtkPiecewiseFunction;
+
+class VTK_EXPORT vtkLIC3DVolumeFilter : public vtkImageAlgorithm
+{
+public:
+	static vtkLIC3DVolumeFilter* New();
+	vtkTypeMacro(vtkLIC3DVolumeFilter, vtkImageAlgorithm);
+	void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+	//@{
+	/**
+	* Get/Set the half length of the convolution kernel, in voxels.
+	* Default is 10.
+	*/
+	vtkSetClampMacro(KernelLength, double, 1., VTK_DOUBLE_MAX);
+	vtkGetMacro(KernelLength, double);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the length, in voxels, of the streamline traced on each side of a
+	* seed voxel which receives convolved values. Longer streamlines reuse the
+	* kernel sums for more voxels. Default is 50.
+	*/
+	vtkSetClampMacro(StreamlineLength, double, 0., VTK_DOUBLE_MAX);
+	vtkGetMacro(StreamlineLength, double);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the integration step, in voxels. Default is 0.5.
+	*/
+	vtkSetClampMacro(StepSize, double, 0.01, 1.);
+	vtkGetMacro(StepSize, double);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the seed of the white noise. Default is 1.
+	*/
+	vtkSetMacro(NoiseSeed, int);
+	vtkGetMacro(NoiseSeed, int);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the fraction of the voxels with a non zero noise. Below 1, the
+	* noise is made of sparse random spots. Default is 1.
+	*/
+	vtkSetClampMacro(NoiseDensity, double, 0.001, 1.);
+	vtkGetMacro(NoiseDensity, double);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the opacity transfer function of the scalars (input array 0).
+	* When set, the voxels of opacity lower or equal to OpacityThreshold are
+	* not visible and do not need the LIC. Default is NULL.
+	*/
+	virtual void SetOpacityFunction(vtkPiecewiseFunction*);
+	vtkGetObjectMacro(OpacityFunction, vtkPiecewiseFunction);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the opacity up to which voxels are skipped. Default is 0.
+	*/
+	vtkSetClampMacro(OpacityThreshold, double, 0., 1.);
+	vtkGetMacro(OpacityThreshold, double);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the vector magnitude, relative to the largest magnitude, below
+	* which voxels are skipped. Default is 0.
+	*/
+	vtkSetClampMacro(MagnitudeThreshold, double, 0., 1.);
+	vtkGetMacro(MagnitudeThreshold, double);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the edge length, in voxels, of the blocks skipped together.
+	* Default is 8.
+	*/
+	vtkSetClampMacro(BlockSize, int, 1, VTK_INT_MAX);
+	vtkGetMacro(BlockSize, int);
+	//@}
+
+	/**
+	* Get the bounds of the blocks convolved by the last execution, which
+	* enclose all the visible voxels. Uninitialized when no block is active.
+	*/
+	vtkGetVector6Macro(ActiveBounds, double);
+
+	//@{
+	/**
+	* Get/Set whether the executions only compute a coarse preview of the LIC,
+	* refined by Refine(). Default is false.
+	*/
+	vtkSetMacro(Progressive, bool);
+	vtkGetMacro(Progressive, bool);
+	vtkBooleanMacro(Progressive, bool);
+	//@}
+
+	//@{
+	/**
+	* Get/Set the dimensions of the lattice convolved for the preview of a
+	* progressive execution. Inputs of fewer voxels are fully convolved.
+	* Default is 64x64x64.
+	*/
+	vtkSetVector3Macro(CoarseDimensions, int);
+	vtkGetVector3Macro(CoarseDimensions, int);
+	//@}
+
+	/**
+	* Convolve the bricks of a progressive output not computed yet, the
+	* closest to the view axis from eye to focalPoint first, for about
+	* timeBudget seconds. The output scalars are modified when bricks were
+	* convolved. Return the number of bricks left.
+	*/
+	vtkIdType Refine(double timeBudget, const double eye[3], const double focalPoint[3]);
+
+	/**
+	* Return the number of bricks of the output left to convolve by Refine().
+	*/
+	vtkIdType GetNumberOfBricksLeft()
+	{
+		return static_cast<vtkIdType>(this->RegionOrder.size()) - this->NextRegion;
+	}
+
+	/**
+	* Overridden to take the opacity function into account.
+	*/
+	vtkMTimeType GetMTime() VTK_OVERRIDE;
+
+protected:
+	vtkLIC3DVolumeFilter();
+	~vtkLIC3DVolumeFilter() override;
+
+	int FillInputPortInformation(int port, vtkInformation* info) VTK_OVERRIDE;
+	int RequestData(vtkInformation*, vtkInformationVector**, vtkInformationVector*) VTK_OVERRIDE;
+
+	/**
+	* Flag the voxels of the active blocks in Mask and update ActiveBounds.
+	* Return the number of active voxels.
+	*/
+	vtkIdType ComputeMask(vtkImageData* input, vtkDataArray* vectors, vtkDataArray* scalars,
+		const float* directions);
+
+	/**
+	* Convolve and output the regions RegionOrder[begin, end).
+	*/
+	void ConvolveRegions(vtkIdType begin, vtkIdType end);
+	void OutputRegions(vtkIdType begin, vtkIdType end);
+
+	/**
+	* Fill the output with the LIC of a coarse lattice of the input.
+	*/
+	void ComputePreview();
+
+	/**
+	* Free the convolution state once the output is complete.
+	*/
+	void ReleaseConvolution();
+
+	double KernelLength;
+	double StreamlineLength;
+	double StepSize;
+	int NoiseSeed;
+	double NoiseDensity;
+	vtkPiecewiseFunction* OpacityFunction;
+	double OpacityThreshold;
+	double MagnitudeThreshold;
+	int BlockSize;
+	double ActiveBounds[6];
+	bool Progressive;
+	int CoarseDimensions[3];
+
+	// Convolution state, kept between the refinements of a progressive output
+	int Dims[3];
+	double RegionOrigin[3];
+	double Spacing[3];
+	std::vector<float> Directions;
+	// 1 for the voxels of the active blocks
+	std::vector<unsigned char> Mask;
+	std::vector<float> Sums;
+	std::vector<int> Hits;
+	// Extents of the regions convolved in parallel, end excluded, and the
+	// order they are convolved in
+	std::vector<int> Regions;
+	std::vector<vtkIdType> RegionOrder;
+	vtkIdType NextRegion;
+	bool HasStatistics;
+	double Mean;
+	double Scale;
+	vtkSmartPointer<vtkDataArray> Scalars;
+	double ScalarMin;
+	vtkSmartPointer<vtkFloatArray> LIC;
+
+private:
+	vtkLIC3DVolumeFilter(const vtkLIC3DVolumeFilter&) = delete;
+	void operator=(const vtkLIC3DVolumeFilter&) = delete;
+};
+
+#endif